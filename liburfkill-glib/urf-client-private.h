@@ -0,0 +1,33 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __URF_CLIENT_PRIVATE_H
+#define __URF_CLIENT_PRIVATE_H
+
+#include "urf-client.h"
+
+G_BEGIN_DECLS
+
+/* Used by UrfDevice and UrfKillswitch to call the daemon methods
+ * without setting up a proxy of their own */
+GDBusProxy		*urf_client_get_daemon_proxy		(GError		**error);
+
+G_END_DECLS
+
+#endif /* __URF_CLIENT_PRIVATE_H */
@@ -38,22 +38,37 @@
 #include <gio/gio.h>
 
 #include "urf-client.h"
+#include "urf-client-private.h"
+#include "urf-device-private.h"
+
+#define URF_SERVICE_NAME		"org.freedesktop.URfkill"
+#define URF_OBJECT_PATH			"/org/freedesktop/URfkill"
+#define OBJECT_MANAGER_INTERFACE	"org.freedesktop.DBus.ObjectManager"
 
 static void	urf_client_class_init	(UrfClientClass	*klass);
 static void	urf_client_init		(UrfClient	*client);
 static void	urf_client_dispose	(GObject	*object);
 static void	urf_client_finalize	(GObject	*object);
+static void	urf_client_initable_iface_init		(GInitableIface		*iface);
+static void	urf_client_async_initable_iface_init	(GAsyncInitableIface	*iface);
 
 #define URF_CLIENT_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), URF_TYPE_CLIENT, UrfClientPrivate))
 
 struct _UrfClientPrivate
 {
 	GDBusProxy	*proxy;
+	GMainContext	*context;
 	GList		*devices;
 	char		*daemon_version;
 	gboolean	 key_control;
 	gboolean	 have_properties;
+	guint		 cache_updates;
+	guint		 stale_reads;
 	gboolean	 is_enumerated;
+	gboolean	 use_object_manager;
+	guint		 properties_changed_id;
+	guint		 interfaces_added_id;
+	guint		 interfaces_removed_id;
 };
 
 enum {
@@ -73,8 +88,65 @@ enum {
 
 static guint signals [URF_CLIENT_LAST_SIGNAL] = { 0 };
 static gpointer urf_client_object = NULL;
+static GDBusProxy *daemon_proxy = NULL;
+
+G_DEFINE_TYPE_WITH_CODE (UrfClient, urf_client, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+						urf_client_initable_iface_init)
+			 G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
+						urf_client_async_initable_iface_init))
+
+/* The blocking calls run their async counterpart on a private main
+ * context, so nothing else is dispatched while they wait */
+typedef struct {
+	GMainContext	*context;
+	GAsyncResult	*res;
+} SyncData;
+
+/**
+ * sync_data_begin:
+ **/
+static void
+sync_data_begin (SyncData *data)
+{
+	data->context = g_main_context_new ();
+	data->res = NULL;
+	g_main_context_push_thread_default (data->context);
+}
+
+/**
+ * sync_data_cb:
+ **/
+static void
+sync_data_cb (GObject      *source,
+	      GAsyncResult *res,
+	      gpointer      user_data)
+{
+	SyncData *data = user_data;
+
+	data->res = g_object_ref (res);
+}
+
+/**
+ * sync_data_wait:
+ **/
+static void
+sync_data_wait (SyncData *data)
+{
+	while (data->res == NULL)
+		g_main_context_iteration (data->context, TRUE);
+}
 
-G_DEFINE_TYPE (UrfClient, urf_client, G_TYPE_OBJECT)
+/**
+ * sync_data_end:
+ **/
+static void
+sync_data_end (SyncData *data)
+{
+	g_main_context_pop_thread_default (data->context);
+	g_object_unref (data->res);
+	g_main_context_unref (data->context);
+}
 
 /**
  * urf_client_find_device:
@@ -180,35 +252,308 @@ urf_client_device_changed (UrfClient  *client,
 }
 
 /**
- * urf_client_get_devices_private:
+ * urf_client_properties_changed_cb:
  **/
 static void
-urf_client_get_devices_private (UrfClient *client,
-				GError    **error)
+urf_client_properties_changed_cb (GDBusConnection *connection,
+				  const gchar     *sender_name,
+				  const gchar     *object_path,
+				  const gchar     *interface_name,
+				  const gchar     *signal_name,
+				  GVariant        *parameters,
+				  gpointer         user_data)
 {
+	UrfClient *client = URF_CLIENT (user_data);
+	UrfDevice *device;
+	GVariant *changed;
+
+	device = urf_client_find_device (client, object_path);
+	if (device == NULL)
+		return;
+
+	g_variant_get (parameters, "(&s@a{sv}^a&s)", NULL, &changed, NULL);
+	urf_device_update_properties (device, changed);
+	g_variant_unref (changed);
+}
+
+/**
+ * urf_client_interfaces_added_cb:
+ **/
+static void
+urf_client_interfaces_added_cb (GDBusConnection *connection,
+				const gchar     *sender_name,
+				const gchar     *object_path,
+				const gchar     *interface_name,
+				const gchar     *signal_name,
+				GVariant        *parameters,
+				gpointer         user_data)
+{
+	UrfClient *client = URF_CLIENT (user_data);
+	UrfDevice *device;
+	GVariant *interfaces;
+	const char *path;
+
+	if (!client->priv->is_enumerated)
+		return;
+
+	g_variant_get (parameters, "(&o@a{sa{sv}})", &path, &interfaces);
+
+	if (!g_variant_lookup (interfaces, URF_DEVICE_INTERFACE_NAME, "@a{sv}", NULL))
+		goto out;
+
+	if (urf_client_find_device (client, path) != NULL) {
+		g_warning ("already added: %s", path);
+		goto out;
+	}
+
+	device = urf_device_new_from_properties (path, interfaces);
+	client->priv->devices = g_list_append (client->priv->devices, device);
+
+	g_signal_emit (client, signals [URF_CLIENT_DEVICE_ADDED], 0, device);
+out:
+	g_variant_unref (interfaces);
+}
+
+/**
+ * urf_client_interfaces_removed_cb:
+ **/
+static void
+urf_client_interfaces_removed_cb (GDBusConnection *connection,
+				  const gchar     *sender_name,
+				  const gchar     *object_path,
+				  const gchar     *interface_name,
+				  const gchar     *signal_name,
+				  GVariant        *parameters,
+				  gpointer         user_data)
+{
+	UrfClient *client = URF_CLIENT (user_data);
+	const char **interfaces;
+	const char *path;
+
+	if (!client->priv->is_enumerated)
+		return;
+
+	g_variant_get (parameters, "(&o^a&s)", &path, &interfaces);
+
+	if (g_strv_length ((gchar **) interfaces) > 0 &&
+	    urf_client_find_device (client, path) != NULL)
+		urf_client_device_removed (client, path);
+
+	g_free (interfaces);
+}
+
+/**
+ * urf_client_subscribe_object_manager:
+ **/
+static void
+urf_client_subscribe_object_manager (UrfClient *client)
+{
+	UrfClientPrivate *priv = client->priv;
+	GDBusConnection *connection;
+
+	connection = g_dbus_proxy_get_connection (priv->proxy);
+
+	/* The signals belong to the context the client was created in,
+	 * not to the private one of a blocking call */
+	g_main_context_push_thread_default (priv->context);
+
+	priv->properties_changed_id =
+		g_dbus_connection_signal_subscribe (connection,
+						    URF_SERVICE_NAME,
+						    "org.freedesktop.DBus.Properties",
+						    "PropertiesChanged",
+						    NULL, NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    urf_client_properties_changed_cb,
+						    client, NULL);
+	priv->interfaces_added_id =
+		g_dbus_connection_signal_subscribe (connection,
+						    URF_SERVICE_NAME,
+						    OBJECT_MANAGER_INTERFACE,
+						    "InterfacesAdded",
+						    URF_OBJECT_PATH, NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    urf_client_interfaces_added_cb,
+						    client, NULL);
+	priv->interfaces_removed_id =
+		g_dbus_connection_signal_subscribe (connection,
+						    URF_SERVICE_NAME,
+						    OBJECT_MANAGER_INTERFACE,
+						    "InterfacesRemoved",
+						    URF_OBJECT_PATH, NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    urf_client_interfaces_removed_cb,
+						    client, NULL);
+
+	g_main_context_pop_thread_default (priv->context);
+}
+
+/**
+ * urf_client_parse_managed_objects:
+ **/
+static void
+urf_client_parse_managed_objects (UrfClient *client,
+				  GVariant  *retval)
+{
+	UrfClientPrivate *priv = client->priv;
+	GVariant *objects;
+	GVariant *interfaces;
+	GVariantIter iter;
+	const char *object_path;
+
+	if (!priv->use_object_manager) {
+		priv->use_object_manager = TRUE;
+		urf_client_subscribe_object_manager (client);
+	}
+
+	objects = g_variant_get_child_value (retval, 0);
+	g_variant_iter_init (&iter, objects);
+	while (g_variant_iter_next (&iter, "{&o@a{sa{sv}}}", &object_path, &interfaces)) {
+		if (g_variant_lookup (interfaces, URF_DEVICE_INTERFACE_NAME, "@a{sv}", NULL) &&
+		    urf_client_find_device (client, object_path) == NULL) {
+			priv->devices = g_list_append (priv->devices,
+						       urf_device_new_from_properties (object_path,
+										       interfaces));
+		}
+		g_variant_unref (interfaces);
+	}
+	g_variant_unref (objects);
+}
+
+/**
+ * urf_client_enumerate_devices_cb:
+ **/
+static void
+urf_client_enumerate_devices_cb (GObject      *source,
+				 GAsyncResult *res,
+				 gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	UrfClient *client = URF_CLIENT (g_task_get_source_object (task));
 	GVariant *retval;
 	GVariantIter *iter;
 	const char *object_path;
-	GError *error_local = NULL;
-
-	g_return_if_fail (URF_IS_CLIENT (client));
-	g_return_if_fail (client->priv->proxy != NULL);
+	GError *error = NULL;
 
-	retval = g_dbus_proxy_call_sync (client->priv->proxy, "EnumerateDevices",
-	                                 NULL,
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error_local);
-	if (error_local) {
-		g_set_error (error, 1, 0, "%s", error_local->message);
-		g_error_free (error_local);
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (retval == NULL) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
 		return;
 	}
 
+	/* Device proxies deliver their signals to the client's context */
+	g_main_context_push_thread_default (client->priv->context);
 	g_variant_get (retval, "(ao)", &iter);
 	while (g_variant_iter_loop (iter, "o", &object_path))
 		urf_client_add (client, object_path);
 	g_variant_iter_free (iter);
+	g_main_context_pop_thread_default (client->priv->context);
 	g_variant_unref (retval);
+
+	client->priv->is_enumerated = TRUE;
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/**
+ * urf_client_get_managed_objects_cb:
+ **/
+static void
+urf_client_get_managed_objects_cb (GObject      *source,
+				   GAsyncResult *res,
+				   gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	UrfClient *client = URF_CLIENT (g_task_get_source_object (task));
+	GVariant *retval;
+	GError *error = NULL;
+
+	retval = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &error);
+	if (retval == NULL) {
+		if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+			/* Older daemons: one proxy pair per device */
+			g_error_free (error);
+			g_dbus_proxy_call (client->priv->proxy, "EnumerateDevices",
+					   NULL,
+					   G_DBUS_CALL_FLAGS_NONE,
+					   -1, g_task_get_cancellable (task),
+					   urf_client_enumerate_devices_cb,
+					   task);
+			return;
+		}
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	urf_client_parse_managed_objects (client, retval);
+	g_variant_unref (retval);
+
+	client->priv->is_enumerated = TRUE;
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/**
+ * urf_client_enumerate_devices_async:
+ * @client: a #UrfClient instance
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously enumerate the devices from the daemon. Call
+ * #urf_client_enumerate_devices_finish from @callback to get the result.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_enumerate_devices_async (UrfClient           *client,
+				    GCancellable        *cancellable,
+				    GAsyncReadyCallback  callback,
+				    gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (URF_IS_CLIENT (client));
+	g_return_if_fail (client->priv->proxy != NULL);
+
+	task = g_task_new (client, cancellable, callback, user_data);
+	g_task_set_source_tag (task, urf_client_enumerate_devices_async);
+
+	g_dbus_connection_call (g_dbus_proxy_get_connection (client->priv->proxy),
+				URF_SERVICE_NAME,
+				URF_OBJECT_PATH,
+				OBJECT_MANAGER_INTERFACE,
+				"GetManagedObjects",
+				NULL,
+				G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
+				G_DBUS_CALL_FLAGS_NONE,
+				-1, cancellable,
+				urf_client_get_managed_objects_cb,
+				task);
+}
+
+/**
+ * urf_client_enumerate_devices_finish:
+ * @client: a #UrfClient instance
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_enumerate_devices_async.
+ *
+ * Return value: #TRUE for success, else #FALSE and @error is used
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_enumerate_devices_finish (UrfClient     *client,
+				     GAsyncResult  *res,
+				     GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (res, client), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (res), error);
 }
 
 /**
@@ -228,23 +573,25 @@ urf_client_enumerate_devices_sync (UrfClient    *client,
 				   GCancellable *cancellable,
 				   GError       **error)
 {
-	UrfClientPrivate *priv = client->priv;
+	SyncData data;
 	GError *error_local = NULL;
-	gboolean ret = FALSE;
+	gboolean ret;
+
+	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
+	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
+
+	sync_data_begin (&data);
+	urf_client_enumerate_devices_async (client, cancellable, sync_data_cb, &data);
+	sync_data_wait (&data);
+	ret = urf_client_enumerate_devices_finish (client, data.res, &error_local);
+	sync_data_end (&data);
 
-	urf_client_get_devices_private (client, &error_local);
 	if (error_local) {
 		g_warning ("Failed to enumerate devices: %s", error_local->message);
 		g_set_error (error, 1, 0, "%s", error_local->message);
-		goto out;
+		g_error_free (error_local);
 	}
 
-	priv->is_enumerated = TRUE;
-
-	ret = TRUE;
-out:
-	if (error_local != NULL)
-		g_error_free (error_local);
 	return ret;
 }
 
@@ -272,6 +619,129 @@ urf_client_get_devices (UrfClient *client)
 	return client->priv->devices;
 }
 
+/**
+ * urf_client_call_cb:
+ **/
+static void
+urf_client_call_cb (GObject      *source,
+		    GAsyncResult *res,
+		    gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	GVariant *retval;
+	GError *error = NULL;
+
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source), res, &error);
+	if (retval == NULL)
+		g_task_return_error (task, error);
+	else
+		g_task_return_pointer (task, retval, (GDestroyNotify) g_variant_unref);
+	g_object_unref (task);
+}
+
+/**
+ * urf_client_call:
+ *
+ * Call @method on the daemon; the reply is collected with
+ * urf_client_call_finish().
+ **/
+static void
+urf_client_call (UrfClient           *client,
+		 const char          *method,
+		 GVariant            *parameters,
+		 GCancellable        *cancellable,
+		 GAsyncReadyCallback  callback,
+		 gpointer             user_data,
+		 gpointer             source_tag)
+{
+	GTask *task;
+
+	task = g_task_new (client, cancellable, callback, user_data);
+	g_task_set_source_tag (task, source_tag);
+
+	g_dbus_proxy_call (client->priv->proxy, method,
+			   parameters,
+			   G_DBUS_CALL_FLAGS_NONE,
+			   -1, cancellable,
+			   urf_client_call_cb,
+			   task);
+}
+
+/**
+ * urf_client_call_finish:
+ **/
+static GVariant *
+urf_client_call_finish (UrfClient     *client,
+			GAsyncResult  *res,
+			GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (res, client), NULL);
+
+	return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+/**
+ * urf_client_set_block_async:
+ * @client: a #UrfClient instance
+ * @type: the type of the devices
+ * @block: %TRUE to block the devices or %FALSE to unblock
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously block or unblock the devices belonging to the type.
+ * Call #urf_client_set_block_finish from @callback to get the result.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_set_block_async (UrfClient           *client,
+			    UrfEnumType          type,
+			    const gboolean       block,
+			    GCancellable        *cancellable,
+			    GAsyncReadyCallback  callback,
+			    gpointer             user_data)
+{
+	g_return_if_fail (URF_IS_CLIENT (client));
+	g_return_if_fail (client->priv->proxy != NULL);
+	g_return_if_fail (type < URF_ENUM_TYPE_NUM);
+
+	urf_client_call (client, "Block",
+			 g_variant_new ("(ub)", type, block),
+			 cancellable, callback, user_data,
+			 urf_client_set_block_async);
+}
+
+/**
+ * urf_client_set_block_finish:
+ * @client: a #UrfClient instance
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_set_block_async.
+ *
+ * Return value: #TRUE for success, else #FALSE and @error is used
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_set_block_finish (UrfClient     *client,
+			     GAsyncResult  *res,
+			     GError       **error)
+{
+	GVariant *retval;
+	gboolean status = FALSE;
+
+	retval = urf_client_call_finish (client, res, error);
+	if (retval == NULL)
+		return FALSE;
+
+	g_variant_get (retval, "(b)", &status);
+	g_variant_unref (retval);
+
+	return status;
+}
+
 /**
  * urf_client_set_block:
  * @client: a #UrfClient instance
@@ -301,29 +771,89 @@ urf_client_set_block (UrfClient      *client,
 		      GCancellable   *cancellable,
 		      GError         **error)
 {
-	GVariant *retval;
-	gboolean status = FALSE;
+	SyncData data;
+	gboolean status;
 	GError *error_local = NULL;
 
 	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
 	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
 	g_return_val_if_fail (type < URF_ENUM_TYPE_NUM, FALSE);
 
-	retval = g_dbus_proxy_call_sync (client->priv->proxy, "Block",
-	                                 g_variant_new ("(ub)", type, block),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error_local);
+	sync_data_begin (&data);
+	urf_client_set_block_async (client, type, block, cancellable,
+				    sync_data_cb, &data);
+	sync_data_wait (&data);
+	status = urf_client_set_block_finish (client, data.res, &error_local);
+	sync_data_end (&data);
+
 	if (error_local) {
 		g_warning ("Couldn't sent BLOCK: %s", error_local->message);
 		g_set_error (error, 1, 0, "%s", error_local->message);
-		goto out;
+		g_error_free (error_local);
 	}
 
+	return status;
+}
+
+/**
+ * urf_client_set_block_idx_async:
+ * @client: a #UrfClient instance
+ * @index: the index of the device
+ * @block: %TRUE to block the device or %FALSE to unblock
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously block or unblock the device by the index. Call
+ * #urf_client_set_block_idx_finish from @callback to get the result.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_set_block_idx_async (UrfClient           *client,
+				const gint           index,
+				const gboolean       block,
+				GCancellable        *cancellable,
+				GAsyncReadyCallback  callback,
+				gpointer             user_data)
+{
+	g_return_if_fail (URF_IS_CLIENT (client));
+	g_return_if_fail (client->priv->proxy != NULL);
+	g_return_if_fail (index >= 0);
+
+	urf_client_call (client, "BlockIdx",
+			 g_variant_new ("(ub)", index, block),
+			 cancellable, callback, user_data,
+			 urf_client_set_block_idx_async);
+}
+
+/**
+ * urf_client_set_block_idx_finish:
+ * @client: a #UrfClient instance
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_set_block_idx_async.
+ *
+ * Return value: #TRUE for success, else #FALSE and @error is used
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_set_block_idx_finish (UrfClient     *client,
+				 GAsyncResult  *res,
+				 GError       **error)
+{
+	GVariant *retval;
+	gboolean status = FALSE;
+
+	retval = urf_client_call_finish (client, res, error);
+	if (retval == NULL)
+		return FALSE;
+
 	g_variant_get (retval, "(b)", &status);
 	g_variant_unref (retval);
-out:
-	if (error_local != NULL)
-		g_error_free (error_local);
+
 	return status;
 }
 
@@ -356,71 +886,181 @@ urf_client_set_block_idx (UrfClient      *client,
 			  GCancellable   *cancellable,
 			  GError         **error)
 {
-	GVariant *retval;
-	gboolean status = FALSE;
+	SyncData data;
+	gboolean status;
 	GError *error_local = NULL;
 
 	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
 	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
 	g_return_val_if_fail (index >= 0, FALSE);
 
-	retval = g_dbus_proxy_call_sync (client->priv->proxy, "BlockIdx",
-	                                 g_variant_new ("(ub)", index, block),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error_local);
+	sync_data_begin (&data);
+	urf_client_set_block_idx_async (client, index, block, cancellable,
+					sync_data_cb, &data);
+	sync_data_wait (&data);
+	status = urf_client_set_block_idx_finish (client, data.res, &error_local);
+	sync_data_end (&data);
+
 	if (error_local) {
 		g_warning ("Couldn't sent BLOCKIDX: %s", error_local->message);
 		g_set_error (error, 1, 0, "%s", error_local->message);
-		goto out;
+		g_error_free (error_local);
+	}
+
+	return status;
+}
+
+/**
+ * urf_client_is_inhibited_async:
+ * @client: a #UrfClient instance
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously get whether the key control is inhibited or not. Call
+ * #urf_client_is_inhibited_finish from @callback to get the result.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_is_inhibited_async (UrfClient           *client,
+			       GCancellable        *cancellable,
+			       GAsyncReadyCallback  callback,
+			       gpointer             user_data)
+{
+	g_return_if_fail (URF_IS_CLIENT (client));
+	g_return_if_fail (client->priv->proxy != NULL);
+
+	urf_client_call (client, "IsInhibited", NULL,
+			 cancellable, callback, user_data,
+			 urf_client_is_inhibited_async);
+}
+
+/**
+ * urf_client_is_inhibited_finish:
+ * @client: a #UrfClient instance
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_is_inhibited_async.
+ *
+ * Return value: #TRUE if the key control is inhibited
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_is_inhibited_finish (UrfClient     *client,
+				GAsyncResult  *res,
+				GError       **error)
+{
+	GVariant *retval;
+	gboolean is_inhibited = FALSE;
+
+	retval = urf_client_call_finish (client, res, error);
+	if (retval == NULL)
+		return FALSE;
+
+	g_variant_get (retval, "(b)", &is_inhibited);
+	g_variant_unref (retval);
+
+	return is_inhibited;
+}
+
+/**
+ * urf_client_is_inhibited:
+ * @client: a #UrfClient instance
+ * @error: a #GError, or %NULL
+ *
+ * Get whether the key control is inhibited or not,
+ *
+ * Return value: #TRUE if the key control is inhibited
+ *
+ * Since: 0.2.0
+ **/
+gboolean
+urf_client_is_inhibited (UrfClient *client,
+			 GError    **error)
+{
+	SyncData data;
+	gboolean is_inhibited;
+	GError *error_local = NULL;
+
+	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
+	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
+
+	sync_data_begin (&data);
+	urf_client_is_inhibited_async (client, NULL, sync_data_cb, &data);
+	sync_data_wait (&data);
+	is_inhibited = urf_client_is_inhibited_finish (client, data.res, &error_local);
+	sync_data_end (&data);
+
+	if (error_local) {
+		g_warning ("Couldn't sent IsInhibited: %s", error_local->message);
+		g_set_error (error, 1, 0, "%s", error_local->message);
+		g_error_free (error_local);
 	}
 
-	g_variant_get (retval, "(b)", &status);
-	g_variant_unref (retval);
-out:
-	if (error_local != NULL)
-		g_error_free (error_local);
-	return status;
+	return is_inhibited;
+}
+
+/**
+ * urf_client_inhibit_async:
+ * @client: a #UrfClient instance
+ * @reason: the reason to inhibit the key control
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously inhibit the rfkill key handling function for this
+ * session. Call #urf_client_inhibit_finish from @callback to get the
+ * cookie.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_inhibit_async (UrfClient           *client,
+			  const char          *reason,
+			  GCancellable        *cancellable,
+			  GAsyncReadyCallback  callback,
+			  gpointer             user_data)
+{
+	g_return_if_fail (URF_IS_CLIENT (client));
+	g_return_if_fail (client->priv->proxy != NULL);
+
+	urf_client_call (client, "Inhibit",
+			 g_variant_new ("(s)", reason),
+			 cancellable, callback, user_data,
+			 urf_client_inhibit_async);
 }
 
 /**
- * urf_client_is_inhibited:
+ * urf_client_inhibit_finish:
  * @client: a #UrfClient instance
+ * @res: the #GAsyncResult passed to the callback
  * @error: a #GError, or %NULL
  *
- * Get whether the key control is inhibited or not,
+ * Finish an operation started with #urf_client_inhibit_async.
  *
- * Return value: #TRUE if the key control is inhibited
+ * Return value: the cookie, or 0 and @error is used
  *
- * Since: 0.2.0
+ * Since: 0.6.0
  **/
-gboolean
-urf_client_is_inhibited (UrfClient *client,
-			 GError    **error)
+guint
+urf_client_inhibit_finish (UrfClient     *client,
+			   GAsyncResult  *res,
+			   GError       **error)
 {
 	GVariant *retval;
-	gboolean is_inhibited = FALSE;
-	GError *error_local = NULL;
-
-	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
-	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
+	guint cookie = 0;
 
-	retval = g_dbus_proxy_call_sync (client->priv->proxy, "IsInhibited",
-	                                 NULL,
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error_local);
-	if (error_local) {
-		g_warning ("Couldn't sent IsInhibited: %s", error_local->message);
-		g_set_error (error, 1, 0, "%s", error_local->message);
-		goto out;
-	}
+	retval = urf_client_call_finish (client, res, error);
+	if (retval == NULL)
+		return 0;
 
-	g_variant_get (retval, "(b)", &is_inhibited);
+	g_variant_get (retval, "(u)", &cookie);
 	g_variant_unref (retval);
-out:
-	if (error_local != NULL)
-		g_error_free (error_local);
-	return is_inhibited;
 
+	return cookie;
 }
 
 /**
@@ -440,31 +1080,86 @@ urf_client_inhibit (UrfClient  *client,
 		    const char *reason,
 		    GError     **error)
 {
-	GVariant *retval;
-	guint cookie = 0;
+	SyncData data;
+	guint cookie;
 	GError *error_local = NULL;
 
 	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
 	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
 
-	retval = g_dbus_proxy_call_sync (client->priv->proxy, "Inhibit",
-	                                 g_variant_new ("(s)", reason),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error_local);
+	sync_data_begin (&data);
+	urf_client_inhibit_async (client, reason, NULL, sync_data_cb, &data);
+	sync_data_wait (&data);
+	cookie = urf_client_inhibit_finish (client, data.res, &error_local);
+	sync_data_end (&data);
+
 	if (error_local) {
 		g_warning ("Couldn't sent INHIBIT: %s", error_local->message);
 		g_set_error (error, 1, 0, "%s", error_local->message);
-		goto out;
+		g_error_free (error_local);
 	}
 
-	g_variant_get (retval, "(u)", &cookie);
-	g_variant_unref (retval);
-out:
-	if (error_local != NULL)
-		g_error_free (error_local);
 	return cookie;
 }
 
+/**
+ * urf_client_uninhibit_async:
+ * @client: a #UrfClient instance
+ * @cookie: the cookie
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously cancel a previous call to #urf_client_inhibit
+ * identified by the cookie. Call #urf_client_uninhibit_finish from
+ * @callback to get the result.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_uninhibit_async (UrfClient           *client,
+			    const guint          cookie,
+			    GCancellable        *cancellable,
+			    GAsyncReadyCallback  callback,
+			    gpointer             user_data)
+{
+	g_return_if_fail (URF_IS_CLIENT (client));
+	g_return_if_fail (client->priv->proxy != NULL);
+
+	urf_client_call (client, "Uninhibit",
+			 g_variant_new ("(u)", cookie),
+			 cancellable, callback, user_data,
+			 urf_client_uninhibit_async);
+}
+
+/**
+ * urf_client_uninhibit_finish:
+ * @client: a #UrfClient instance
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_uninhibit_async.
+ *
+ * Return value: #TRUE for success, else #FALSE and @error is used
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_uninhibit_finish (UrfClient     *client,
+			     GAsyncResult  *res,
+			     GError       **error)
+{
+	GVariant *retval;
+
+	retval = urf_client_call_finish (client, res, error);
+	if (retval == NULL)
+		return FALSE;
+
+	g_variant_unref (retval);
+
+	return TRUE;
+}
+
 /**
  * urf_client_uninhibit:
  * @client: a #UrfClient instance
@@ -481,13 +1176,10 @@ urf_client_uninhibit (UrfClient   *client,
 	g_return_if_fail (URF_IS_CLIENT (client));
 	g_return_if_fail (client->priv->proxy != NULL);
 
-	g_dbus_proxy_call (client->priv->proxy, "Uninhibit",
-	                   g_variant_new ("(u)", cookie),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, NULL, NULL);
+	/* Nobody waits for the reply */
+	urf_client_uninhibit_async (client, cookie, NULL, NULL, NULL);
 }
 
-
 /**
  * urf_client_set_wlan_block:
  * @client: a #UrfClient instance
@@ -546,21 +1238,108 @@ urf_client_set_wwan_block (UrfClient     *client,
 }
 
 /**
- * urf_client_get_properties_sync:
+ * urf_client_update_property:
+ **/
+static gboolean
+urf_client_update_property (UrfClient  *client,
+			    const char *name,
+			    GVariant   *value)
+{
+	UrfClientPrivate *priv = client->priv;
+
+	if (g_strcmp0 (name, "DaemonVersion") == 0) {
+		if (g_strcmp0 (priv->daemon_version, g_variant_get_string (value, NULL)) == 0)
+			return FALSE;
+		g_free (priv->daemon_version);
+		priv->daemon_version = g_variant_dup_string (value, NULL);
+		g_object_notify (G_OBJECT (client), "daemon-version");
+	} else if (g_strcmp0 (name, "KeyControl") == 0) {
+		if (priv->key_control == g_variant_get_boolean (value))
+			return FALSE;
+		priv->key_control = g_variant_get_boolean (value);
+		g_object_notify (G_OBJECT (client), "key-control");
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * urf_client_load_properties:
+ *
+ * Fill the property cache from the values the proxy got when it was
+ * set up. Later changes arrive through PropertiesChanged.
+ **/
+static void
+urf_client_load_properties (UrfClient *client)
+{
+	UrfClientPrivate *priv = client->priv;
+	const char *names[] = { "DaemonVersion", "KeyControl", NULL };
+	GVariant *value;
+	guint i;
+
+	for (i = 0; names[i] != NULL; i++) {
+		value = g_dbus_proxy_get_cached_property (priv->proxy, names[i]);
+		if (value == NULL)
+			continue;
+		urf_client_update_property (client, names[i], value);
+		g_variant_unref (value);
+	}
+
+	priv->have_properties = TRUE;
+}
+
+/**
+ * urf_client_proxy_properties_changed_cb:
  **/
 static void
-urf_client_get_properties_sync (UrfClient *client)
+urf_client_proxy_properties_changed_cb (GDBusProxy *proxy,
+					GVariant   *changed_properties,
+					GStrv       invalidated_properties,
+					gpointer    user_data)
 {
+	UrfClient *client = URF_CLIENT (user_data);
 	UrfClientPrivate *priv = client->priv;
+	GVariantIter iter;
+	const char *name;
 	GVariant *value;
-	gsize length;
+	guint changed = 0;
+
+	g_variant_iter_init (&iter, changed_properties);
+	while (g_variant_iter_next (&iter, "{&sv}", &name, &value)) {
+		if (urf_client_update_property (client, name, value))
+			changed++;
+		g_variant_unref (value);
+	}
+
+	priv->cache_updates++;
+	g_debug ("Property cache update %u: %u changed, %u stale reads so far",
+		 priv->cache_updates, changed, priv->stale_reads);
+}
+
+/**
+ * urf_client_check_stale:
+ *
+ * The cache keeps the last values it saw when the daemon goes away,
+ * and only has the defaults until it is loaded; count the reads served
+ * that way.
+ **/
+static void
+urf_client_check_stale (UrfClient *client)
+{
+	UrfClientPrivate *priv = client->priv;
+	char *owner;
 
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "DaemonVersion");
-	g_free (priv->daemon_version);
-	priv->daemon_version = g_variant_dup_string (value, &length);
+	if (priv->proxy == NULL || !priv->have_properties) {
+		priv->stale_reads++;
+		return;
+	}
 
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "KeyControl");
-	priv->key_control = g_variant_get_boolean (value);
+	owner = g_dbus_proxy_get_name_owner (priv->proxy);
+	if (owner == NULL)
+		priv->stale_reads++;
+	g_free (owner);
 }
 
 /**
@@ -577,10 +1356,46 @@ const char *
 urf_client_get_daemon_version (UrfClient *client)
 {
 	g_return_val_if_fail (URF_IS_CLIENT (client), NULL);
-	urf_client_get_properties_sync (client);
+	urf_client_check_stale (client);
 	return client->priv->daemon_version;
 }
 
+/**
+ * urf_client_get_cache_updates:
+ * @client: a #UrfClient instance
+ *
+ * Get the number of property changes the daemon pushed into the
+ * client's cache
+ *
+ * Return value: the number of cache updates
+ *
+ * Since: 0.6.0
+ **/
+guint
+urf_client_get_cache_updates (UrfClient *client)
+{
+	g_return_val_if_fail (URF_IS_CLIENT (client), 0);
+	return client->priv->cache_updates;
+}
+
+/**
+ * urf_client_get_stale_reads:
+ * @client: a #UrfClient instance
+ *
+ * Get the number of reads answered from the cache while the daemon
+ * was not running or before the cache was loaded
+ *
+ * Return value: the number of stale reads
+ *
+ * Since: 0.6.0
+ **/
+guint
+urf_client_get_stale_reads (UrfClient *client)
+{
+	g_return_val_if_fail (URF_IS_CLIENT (client), 0);
+	return client->priv->stale_reads;
+}
+
 /**
  * urf_client_get_key_control:
  **/
@@ -588,7 +1403,7 @@ static gboolean
 urf_client_get_key_control (UrfClient *client)
 {
 	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
-	urf_client_get_properties_sync (client);
+	urf_client_check_stale (client);
 	return client->priv->key_control;
 }
 
@@ -603,8 +1418,6 @@ urf_client_get_property (GObject    *object,
 {
 	UrfClient *client = URF_CLIENT (object);
 
-	urf_client_get_properties_sync (client);
-
 	switch (prop_id) {
 	case PROP_DAEMON_VERSION:
 		g_value_set_string (value, urf_client_get_daemon_version (client));
@@ -752,6 +1565,12 @@ urf_client_proxy_signal_cb (GDBusProxy *proxy,
 	if (!client->priv->is_enumerated)
 		return;
 
+	/* Devices come and go through InterfacesAdded/Removed then */
+	if (client->priv->use_object_manager &&
+	    (g_strcmp0 (signal_name, "DeviceAdded") == 0 ||
+	     g_strcmp0 (signal_name, "DeviceRemoved") == 0))
+		return;
+
 	if (g_strcmp0 (signal_name, "DeviceAdded") == 0) {
 		char *device_path;
 		g_variant_get (parameters, "(o)", &device_path);
@@ -767,6 +1586,150 @@ urf_client_proxy_signal_cb (GDBusProxy *proxy,
 	}
 }
 
+/**
+ * urf_client_setup_proxy:
+ **/
+static void
+urf_client_setup_proxy (UrfClient  *client,
+			GDBusProxy *proxy)
+{
+	client->priv->proxy = proxy;
+
+	urf_client_load_properties (client);
+
+	/* callbacks */
+	g_signal_connect (client->priv->proxy, "g-signal",
+	                  G_CALLBACK (urf_client_proxy_signal_cb), client);
+	g_signal_connect (client->priv->proxy, "g-properties-changed",
+	                  G_CALLBACK (urf_client_proxy_properties_changed_cb), client);
+}
+
+/**
+ * urf_client_initable_init:
+ **/
+static gboolean
+urf_client_initable_init (GInitable     *initable,
+			  GCancellable  *cancellable,
+			  GError       **error)
+{
+	UrfClient *client = URF_CLIENT (initable);
+	GDBusProxy *proxy;
+
+	if (client->priv->proxy != NULL)
+		return TRUE;
+
+	/* connect to main interface */
+	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                                       G_DBUS_PROXY_FLAGS_NONE,
+	                                       NULL,
+	                                       URF_SERVICE_NAME,
+	                                       URF_OBJECT_PATH,
+	                                       "org.freedesktop.URfkill",
+	                                       cancellable,
+	                                       error);
+	if (proxy == NULL)
+		return FALSE;
+
+	urf_client_setup_proxy (client, proxy);
+
+	return TRUE;
+}
+
+/**
+ * urf_client_initable_iface_init:
+ **/
+static void
+urf_client_initable_iface_init (GInitableIface *iface)
+{
+	iface->init = urf_client_initable_init;
+}
+
+/**
+ * urf_client_proxy_new_cb:
+ **/
+static void
+urf_client_proxy_new_cb (GObject      *source,
+			 GAsyncResult *res,
+			 gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	UrfClient *client = URF_CLIENT (g_task_get_source_object (task));
+	GDBusProxy *proxy;
+	GError *error = NULL;
+
+	proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (proxy == NULL) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	if (client->priv->proxy == NULL)
+		urf_client_setup_proxy (client, proxy);
+	else
+		g_object_unref (proxy);
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/**
+ * urf_client_async_initable_init_async:
+ **/
+static void
+urf_client_async_initable_init_async (GAsyncInitable      *initable,
+				      int                  io_priority,
+				      GCancellable        *cancellable,
+				      GAsyncReadyCallback  callback,
+				      gpointer             user_data)
+{
+	UrfClient *client = URF_CLIENT (initable);
+	GTask *task;
+
+	task = g_task_new (client, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+
+	if (client->priv->proxy != NULL) {
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	/* connect to main interface */
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+	                          G_DBUS_PROXY_FLAGS_NONE,
+	                          NULL,
+	                          URF_SERVICE_NAME,
+	                          URF_OBJECT_PATH,
+	                          "org.freedesktop.URfkill",
+	                          cancellable,
+	                          urf_client_proxy_new_cb,
+	                          task);
+}
+
+/**
+ * urf_client_async_initable_init_finish:
+ **/
+static gboolean
+urf_client_async_initable_init_finish (GAsyncInitable  *initable,
+				       GAsyncResult    *res,
+				       GError         **error)
+{
+	g_return_val_if_fail (g_task_is_valid (res, initable), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/**
+ * urf_client_async_initable_iface_init:
+ **/
+static void
+urf_client_async_initable_iface_init (GAsyncInitableIface *iface)
+{
+	iface->init_async = urf_client_async_initable_init_async;
+	iface->init_finish = urf_client_async_initable_init_finish;
+}
+
 /**
  * urf_client_init:
  * @client: This class instance
@@ -774,34 +1737,16 @@ urf_client_proxy_signal_cb (GDBusProxy *proxy,
 static void
 urf_client_init (UrfClient *client)
 {
-	GError *error = NULL;
-
 	client->priv = URF_CLIENT_GET_PRIVATE (client);
+	client->priv->proxy = NULL;
+	client->priv->context = g_main_context_ref_thread_default ();
 	client->priv->daemon_version = NULL;
 	client->priv->key_control = FALSE;
 	client->priv->have_properties = FALSE;
+	client->priv->cache_updates = 0;
+	client->priv->stale_reads = 0;
 	client->priv->is_enumerated = FALSE;
 	client->priv->devices = NULL;
-
-	/* connect to main interface */
-	client->priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                                     G_DBUS_PROXY_FLAGS_NONE,
-	                                                     NULL,
-	                                                     "org.freedesktop.URfkill",
-	                                                     "/org/freedesktop/URfkill",
-	                                                     "org.freedesktop.URfkill",
-	                                                     NULL,
-	                                                     &error);
-	if (error) {
-		g_warning ("Couldn't connect to proxy: %s", error->message);
-		g_error_free (error);
-		return;
-	}
-
-	/* callbacks */
-	g_signal_connect (client->priv->proxy, "g-signal",
-	                  G_CALLBACK (urf_client_proxy_signal_cb), client);
-	return;
 }
 
 /**
@@ -817,6 +1762,23 @@ urf_client_dispose (GObject *object)
 	client = URF_CLIENT (object);
 
 	if (client->priv->proxy) {
+		GDBusConnection *connection;
+
+		connection = g_dbus_proxy_get_connection (client->priv->proxy);
+		if (client->priv->properties_changed_id > 0)
+			g_dbus_connection_signal_unsubscribe (connection,
+							      client->priv->properties_changed_id);
+		if (client->priv->interfaces_added_id > 0)
+			g_dbus_connection_signal_unsubscribe (connection,
+							      client->priv->interfaces_added_id);
+		if (client->priv->interfaces_removed_id > 0)
+			g_dbus_connection_signal_unsubscribe (connection,
+							      client->priv->interfaces_removed_id);
+		client->priv->properties_changed_id = 0;
+		client->priv->interfaces_added_id = 0;
+		client->priv->interfaces_removed_id = 0;
+
+		g_signal_handlers_disconnect_by_data (client->priv->proxy, client);
 		g_object_unref (client->priv->proxy);
 		client->priv->proxy = NULL;
 	}
@@ -838,6 +1800,7 @@ urf_client_finalize (GObject *object)
 	client = URF_CLIENT (object);
 
 	g_free (client->priv->daemon_version);
+	g_main_context_unref (client->priv->context);
 
 	if (client->priv->devices) {
 		for (item = client->priv->devices; item; item = item->next)
@@ -849,6 +1812,33 @@ urf_client_finalize (GObject *object)
 	G_OBJECT_CLASS (urf_client_parent_class)->finalize (object);
 }
 
+/**
+ * urf_client_get_daemon_proxy:
+ *
+ * Get the proxy shared by the objects of the library to call the daemon
+ * methods. It neither loads the properties nor listens to the signals,
+ * so it is cheap to set up and is kept until the process exits.
+ *
+ * Return value: (transfer none): the proxy, or %NULL and @error is used
+ **/
+GDBusProxy *
+urf_client_get_daemon_proxy (GError **error)
+{
+	if (daemon_proxy != NULL)
+		return daemon_proxy;
+
+	daemon_proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                                              G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+	                                              G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+	                                              NULL,
+	                                              URF_SERVICE_NAME,
+	                                              URF_OBJECT_PATH,
+	                                              "org.freedesktop.URfkill",
+	                                              NULL,
+	                                              error);
+	return daemon_proxy;
+}
+
 /**
  * urf_client_new:
  *
@@ -860,12 +1850,95 @@ urf_client_finalize (GObject *object)
 UrfClient *
 urf_client_new (void)
 {
+	GError *error = NULL;
+
 	if (urf_client_object != NULL) {
 		g_object_ref (urf_client_object);
 	} else {
 		urf_client_object = g_object_new (URF_TYPE_CLIENT, NULL);
 		g_object_add_weak_pointer (urf_client_object, &urf_client_object);
+
+		if (!g_initable_init (G_INITABLE (urf_client_object), NULL, &error)) {
+			g_warning ("Couldn't connect to proxy: %s", error->message);
+			g_error_free (error);
+		}
 	}
 	return URF_CLIENT (urf_client_object);
 }
 
+/**
+ * urf_client_new_init_cb:
+ **/
+static void
+urf_client_new_init_cb (GObject      *source,
+			GAsyncResult *res,
+			gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	GError *error = NULL;
+
+	if (!g_async_initable_init_finish (G_ASYNC_INITABLE (source), res, &error)) {
+		g_object_unref (source);
+		g_task_return_error (task, error);
+	} else {
+		g_task_return_pointer (task, source, g_object_unref);
+	}
+	g_object_unref (task);
+}
+
+/**
+ * urf_client_new_async:
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the client is ready
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously creates a #UrfClient object and connects it to the
+ * daemon without blocking. Call #urf_client_new_finish from @callback
+ * to get the client.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_new_async (GCancellable        *cancellable,
+		      GAsyncReadyCallback  callback,
+		      gpointer             user_data)
+{
+	GTask *task;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_source_tag (task, urf_client_new_async);
+
+	if (urf_client_object != NULL) {
+		g_object_ref (urf_client_object);
+	} else {
+		urf_client_object = g_object_new (URF_TYPE_CLIENT, NULL);
+		g_object_add_weak_pointer (urf_client_object, &urf_client_object);
+	}
+
+	g_async_initable_init_async (G_ASYNC_INITABLE (urf_client_object),
+				     G_PRIORITY_DEFAULT,
+				     cancellable,
+				     urf_client_new_init_cb,
+				     task);
+}
+
+/**
+ * urf_client_new_finish:
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_new_async.
+ *
+ * Return value: (transfer full): a #UrfClient object, or %NULL and
+ * @error is used
+ *
+ * Since: 0.6.0
+ **/
+UrfClient *
+urf_client_new_finish (GAsyncResult  *res,
+		       GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (res, NULL), NULL);
+
+	return g_task_propagate_pointer (G_TASK (res), error);
+}
@@ -80,6 +80,11 @@ struct _UrfClientClass
 /* general */
 GType		 urf_client_get_type			(void);
 UrfClient	*urf_client_new				(void);
+void		 urf_client_new_async			(GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+UrfClient	*urf_client_new_finish			(GAsyncResult	*res,
+							 GError		**error);
 
 /* generic */
 gboolean	 urf_client_enumerate_devices_sync	(UrfClient	*client,
@@ -104,6 +109,56 @@ guint		 urf_client_inhibit			(UrfClient	*client,
 void		 urf_client_uninhibit			(UrfClient	*client,
 							 const guint	 cookie);
 
+/* asynchronous */
+void		 urf_client_enumerate_devices_async	(UrfClient	*client,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+gboolean	 urf_client_enumerate_devices_finish	(UrfClient	*client,
+							 GAsyncResult	*res,
+							 GError		**error);
+void		 urf_client_set_block_async		(UrfClient	*client,
+							 UrfEnumType	 type,
+							 const gboolean	 block,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+gboolean	 urf_client_set_block_finish		(UrfClient	*client,
+							 GAsyncResult	*res,
+							 GError		**error);
+void		 urf_client_set_block_idx_async		(UrfClient	*client,
+							 const gint	 index,
+							 const gboolean	 block,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+gboolean	 urf_client_set_block_idx_finish	(UrfClient	*client,
+							 GAsyncResult	*res,
+							 GError		**error);
+void		 urf_client_is_inhibited_async		(UrfClient	*client,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+gboolean	 urf_client_is_inhibited_finish		(UrfClient	*client,
+							 GAsyncResult	*res,
+							 GError		**error);
+void		 urf_client_inhibit_async		(UrfClient	*client,
+							 const char	*reason,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+guint		 urf_client_inhibit_finish		(UrfClient	*client,
+							 GAsyncResult	*res,
+							 GError		**error);
+void		 urf_client_uninhibit_async		(UrfClient	*client,
+							 const guint	 cookie,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+gboolean	 urf_client_uninhibit_finish		(UrfClient	*client,
+							 GAsyncResult	*res,
+							 GError		**error);
+
 /* specific type */
 gboolean	 urf_client_set_wlan_block		(UrfClient	*client,
 							 const gboolean  block);
@@ -114,6 +169,8 @@ gboolean	 urf_client_set_wwan_block		(UrfClient	*client,
 
 /* accessors */
 const char	*urf_client_get_daemon_version		(UrfClient	*client);
+guint		 urf_client_get_cache_updates		(UrfClient	*client);
+guint		 urf_client_get_stale_reads		(UrfClient	*client);
 
 G_END_DECLS
 
@@ -0,0 +1,38 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __URF_DEVICE_PRIVATE_H
+#define __URF_DEVICE_PRIVATE_H
+
+#include "urf-device.h"
+
+G_BEGIN_DECLS
+
+#define URF_DEVICE_INTERFACE_NAME	"org.freedesktop.URfkill.Device"
+
+/* Used by UrfClient, which gets the properties of every device from
+ * GetManagedObjects and tracks changes with a single subscription */
+UrfDevice		*urf_device_new_from_properties		(const char	*object_path,
+								 GVariant	*interfaces);
+void			 urf_device_update_properties		(UrfDevice	*device,
+								 GVariant	*properties);
+
+G_END_DECLS
+
+#endif /* __URF_DEVICE_PRIVATE_H */
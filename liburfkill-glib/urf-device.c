@@ -37,7 +37,9 @@
 #include <gio/gio.h>
 
 #include "urf-device.h"
+#include "urf-device-private.h"
 #include "urf-enum.h"
+#include "urf-client-private.h"
 
 #define URF_DEVICE_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
 					URF_TYPE_DEVICE, UrfDevicePrivate))
@@ -83,12 +85,16 @@ urf_device_refresh_private (UrfDevice *device,
 
 	if (priv->specialized_proxy) {
 		value = g_dbus_proxy_get_cached_property (priv->specialized_proxy, "soft");
-		if (value)
+		if (value) {
 			priv->soft = g_variant_get_boolean (value);
+			g_variant_unref (value);
+		}
 
 		value = g_dbus_proxy_get_cached_property (priv->specialized_proxy, "hard");
-		if (value)
+		if (value) {
 			priv->hard = g_variant_get_boolean (value);
+			g_variant_unref (value);
+		}
 	}
 
 	if (priv->is_initialized)
@@ -96,16 +102,20 @@ urf_device_refresh_private (UrfDevice *device,
 
 	value = g_dbus_proxy_get_cached_property (priv->proxy, "index");
 	priv->index = g_variant_get_int32 (value);
+	g_variant_unref (value);
 
 	value = g_dbus_proxy_get_cached_property (priv->proxy, "type");
 	priv->type = g_variant_get_int32 (value);
+	g_variant_unref (value);
 
 	value = g_dbus_proxy_get_cached_property (priv->proxy, "platform");
 	priv->platform = g_variant_get_boolean (value);
+	g_variant_unref (value);
 
 	value = g_dbus_proxy_get_cached_property (priv->proxy, "name");
+	g_free (priv->name);
 	priv->name = g_variant_dup_string (value, &length);
-
+	g_variant_unref (value);
 }
 
 /**
@@ -119,7 +129,7 @@ urf_device_changed_cb (GDBusProxy *proxy,
 {
 	UrfDevice *device = URF_DEVICE (user_data);
 
-	urf_device_refresh_private (device, NULL);
+	urf_device_update_properties (device, changed_properties);
 }
 
 /**
@@ -206,6 +216,79 @@ out:
 	return ret;
 }
 
+/**
+ * urf_device_update_properties:
+ * @device: a #UrfDevice instance
+ * @properties: an a{sv} #GVariant of the device or backend interface
+ *
+ * Update the cached properties from a GetManagedObjects reply or a
+ * PropertiesChanged signal.
+ **/
+void
+urf_device_update_properties (UrfDevice *device,
+			      GVariant  *properties)
+{
+	UrfDevicePrivate *priv = device->priv;
+	GVariantIter iter;
+	const char *key;
+	GVariant *value;
+
+	g_variant_iter_init (&iter, properties);
+	while (g_variant_iter_next (&iter, "{&sv}", &key, &value)) {
+		if (g_strcmp0 (key, "index") == 0) {
+			priv->index = g_variant_get_int32 (value);
+		} else if (g_strcmp0 (key, "type") == 0) {
+			priv->type = g_variant_get_int32 (value);
+		} else if (g_strcmp0 (key, "platform") == 0) {
+			priv->platform = g_variant_get_boolean (value);
+		} else if (g_strcmp0 (key, "name") == 0) {
+			g_free (priv->name);
+			priv->name = g_variant_dup_string (value, NULL);
+		} else if (g_strcmp0 (key, "urftype") == 0) {
+			g_free (priv->urftype);
+			priv->urftype = g_variant_dup_string (value, NULL);
+		} else if (g_strcmp0 (key, "soft") == 0) {
+			priv->soft = g_variant_get_boolean (value);
+		} else if (g_strcmp0 (key, "hard") == 0) {
+			priv->hard = g_variant_get_boolean (value);
+		}
+		g_variant_unref (value);
+	}
+}
+
+/**
+ * urf_device_new_from_properties:
+ * @object_path: the #UrfDevice object path
+ * @interfaces: an a{sa{sv}} #GVariant with the interfaces of the device
+ *
+ * Create a device from the properties the daemon reported through
+ * GetManagedObjects or InterfacesAdded, without any round trip of its
+ * own.
+ *
+ * Return value: a new #UrfDevice object.
+ **/
+UrfDevice *
+urf_device_new_from_properties (const char *object_path,
+				GVariant   *interfaces)
+{
+	UrfDevice *device;
+	GVariantIter iter;
+	GVariant *properties;
+
+	device = urf_device_new ();
+	device->priv->object_path = g_strdup (object_path);
+
+	g_variant_iter_init (&iter, interfaces);
+	while (g_variant_iter_next (&iter, "{&s@a{sv}}", NULL, &properties)) {
+		urf_device_update_properties (device, properties);
+		g_variant_unref (properties);
+	}
+
+	device->priv->is_initialized = TRUE;
+
+	return device;
+}
+
 /**
  * urf_device_get_object_path:
  * @device: a #UrfDevice instance
@@ -246,8 +329,6 @@ set_block_idx_cb (GDBusProxy     *proxy,
 	} else if (!status) {
 		g_warning ("Failed to set BLOCK");
 	}
-
-	g_object_unref (proxy);
 }
 
 /**
@@ -260,14 +341,7 @@ urf_device_set_block (UrfDevice *device,
 	GDBusProxy *proxy;
 	GError *error = NULL;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                       G_DBUS_PROXY_FLAGS_NONE,
-	                                       NULL,
-	                                       "org.freedesktop.URfkill",
-	                                       "/org/freedesktop/URfkill",
-	                                       "org.freedesktop.URfkill",
-	                                       NULL,
-	                                       &error);
+	proxy = urf_client_get_daemon_proxy (&error);
 	if (error) {
 		g_warning ("Couldn't connect to proxy to set block: %s",
 		           error->message);
@@ -358,6 +432,7 @@ urf_device_finalize (GObject *object)
 	priv = URF_DEVICE (object)->priv;
 
 	g_free (priv->name);
+	g_free (priv->urftype);
 	g_free (priv->object_path);
 
 	G_OBJECT_CLASS(urf_device_parent_class)->finalize(object);
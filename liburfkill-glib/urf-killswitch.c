@@ -38,6 +38,7 @@
 
 #include "urf-killswitch.h"
 #include "urf-enum.h"
+#include "urf-client-private.h"
 
 #define URF_KILLSWITCH_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
 					URF_TYPE_KILLSWITCH, UrfKillswitchPrivate))
@@ -98,11 +99,11 @@ urf_killswitch_changed_cb (GDBusProxy *proxy,
 {
 	UrfKillswitch *killswitch = URF_KILLSWITCH (user_data);
 	UrfKillswitchPrivate *priv = killswitch->priv;
-	GVariant *value;
 	int state;
 
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "state");
-	state = g_variant_get_int32 (value);
+	if (!g_variant_lookup (changed_properties, "state", "i", &state))
+		return;
+
 	if (priv->state != state) {
 		priv->state = state;
 		g_signal_emit (killswitch,
@@ -153,6 +154,7 @@ urf_killswitch_set_object_path_sync (UrfKillswitch *killswitch,
 
 	value = g_dbus_proxy_get_cached_property (priv->proxy, "state");
 	priv->state = g_variant_get_int32 (value);
+	g_variant_unref (value);
 
 	/* connect signals */
 	g_signal_connect (priv->proxy, "g-properties-changed",
@@ -235,8 +237,6 @@ set_block_cb (GDBusProxy     *proxy,
 	} else if (!status) {
 		g_warning ("Failed to set BLOCK");
 	}
-
-	g_object_unref (proxy);
 }
 
 /**
@@ -256,14 +256,7 @@ urf_killswitch_set_block (UrfKillswitch  *killswitch,
 	else
 		block = TRUE;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                       G_DBUS_PROXY_FLAGS_NONE,
-	                                       NULL,
-	                                       "org.freedesktop.URfkill",
-	                                       "/org/freedesktop/URfkill",
-	                                       "org.freedesktop.URfkill",
-	                                       NULL,
-	                                       &error);
+	proxy = urf_client_get_daemon_proxy (&error);
 	if (error) {
 		g_warning ("Couldn't connect to proxy to set block: %s",
 		           error->message);
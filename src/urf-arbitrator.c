@@ -40,6 +40,9 @@
 #define RFKILL_EVENT_SIZE_V1    8
 #endif
 
+/* maximum number of events taken from /dev/rfkill by a single read */
+#define RFKILL_EVENT_BATCH      32
+
 #include "urf-config.h"
 #include "urf-daemon.h"
 #include "urf-arbitrator.h"
@@ -48,6 +51,7 @@
 
 #include "urf-device.h"
 #include "urf-device-kernel.h"
+#include "urf-kernel-batch.h"
 
 #ifdef HAS_HYBRIS
 #include <hybris/properties/properties.h>
@@ -73,6 +77,11 @@ static int signals[LAST_SIGNAL] = { 0 };
 struct fm_task_data {
 	KillswitchState initial_state[NUM_RFKILL_TYPES];
 	gboolean final_state[NUM_RFKILL_TYPES];
+	gboolean done[NUM_RFKILL_TYPES];
+	gboolean block;
+	guint pending;
+	GError *error;
+	GString *failed;
 };
 
 struct UrfArbitratorPrivate {
@@ -82,12 +91,16 @@ struct UrfArbitratorPrivate {
 	gboolean	 persist;
 	GIOChannel	*channel;
 	guint		 watch_id;
-	GList		*devices; /* a GList of UrfDevice */
+	GQueue		 devices; /* UrfDevice, in order of arrival */
+	GHashTable	*device_index; /* index -> link in devices */
+	GHashTable	*type_devices[NUM_RFKILL_TYPES]; /* sets of UrfDevice */
 	UrfKillswitch	*killswitch[NUM_RFKILL_TYPES];
-	GTask           *flight_mode_task;
-	GTask           *pending_block_task;
-	int              block_index;
-	gboolean         pending_block;
+	UrfKernelBatch	*batch;
+	GHashTable	*startup_info; /* index -> RfkillDeviceInfo, startup only */
+	guint		 startup_hits;
+	gint		 expected_soft[NUM_RFKILL_TYPES]; /* -1 or our pending write */
+	guint		 suppressed_writes;
+	guint		 suppressed_echoes;
 #ifdef HAS_HYBRIS
 	/* WLAN devices are controlled via libhybris */
 	gboolean	hybris_wlan;
@@ -96,11 +109,6 @@ struct UrfArbitratorPrivate {
 
 G_DEFINE_TYPE(UrfArbitrator, urf_arbitrator, G_TYPE_OBJECT)
 
-static void
-urf_arbitrator_flight_mode_cb (GObject *source,
-			       GAsyncResult *res,
-			       gpointer user_data);
-
 /**
  * urf_arbitrator_find_device:
  **/
@@ -109,18 +117,61 @@ urf_arbitrator_find_device (UrfArbitrator *arbitrator,
                             gint           index)
 {
 	UrfArbitratorPrivate *priv = arbitrator->priv;
-	UrfDevice *device;
-	GList *item;
+	GList *link;
 
 	g_return_val_if_fail (index >= 0, NULL);
 
-	for (item = priv->devices; item != NULL; item = item->next) {
-		device = (UrfDevice *)item->data;
-		if (urf_device_get_index (device) == index)
-			return device;
-	}
+	link = g_hash_table_lookup (priv->device_index, GINT_TO_POINTER (index));
+	if (link == NULL)
+		return NULL;
 
-	return NULL;
+	return (UrfDevice *)link->data;
+}
+
+/**
+ * urf_arbitrator_index_device:
+ *
+ * Appends @device to the device list and indexes it by rfkill index
+ * and by type.
+ **/
+static void
+urf_arbitrator_index_device (UrfArbitrator *arbitrator,
+			     UrfDevice     *device)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	gint type = urf_device_get_device_type (device);
+
+	g_queue_push_tail (&priv->devices, device);
+	g_hash_table_insert (priv->device_index,
+			     GINT_TO_POINTER (urf_device_get_index (device)),
+			     g_queue_peek_tail_link (&priv->devices));
+
+	if (type >= 0 && type < NUM_RFKILL_TYPES)
+		g_hash_table_add (priv->type_devices[type], device);
+}
+
+/**
+ * urf_arbitrator_unindex_device:
+ *
+ * Removes @device from the device list and both indexes.
+ **/
+static void
+urf_arbitrator_unindex_device (UrfArbitrator *arbitrator,
+			       UrfDevice     *device)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	gint index = urf_device_get_index (device);
+	gint type = urf_device_get_device_type (device);
+	GList *link;
+
+	link = g_hash_table_lookup (priv->device_index, GINT_TO_POINTER (index));
+	g_return_if_fail (link != NULL && link->data == device);
+
+	g_hash_table_remove (priv->device_index, GINT_TO_POINTER (index));
+	g_queue_delete_link (&priv->devices, link);
+
+	if (type >= 0 && type < NUM_RFKILL_TYPES)
+		g_hash_table_remove (priv->type_devices[type], device);
 }
 
 /**
@@ -172,57 +223,190 @@ urf_arbitrator_set_block_idx (UrfArbitrator  *arbitrator,
 }
 
 /**
- * handle_flight_mode_killswitch
+ * urf_arbitrator_type_is_soft:
+ *
+ * Whether every kernel device of @type is soft blocked as @soft says.
+ * Our writes to /dev/rfkill never change the other devices.
  **/
 static gboolean
-handle_flight_mode_killswitch (UrfArbitrator  *arbitrator, const gboolean block)
+urf_arbitrator_type_is_soft (UrfArbitrator *arbitrator,
+			     gint           type,
+			     gboolean       soft)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	g_hash_table_iter_init (&iter, arbitrator->priv->type_devices[type]);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (URF_IS_DEVICE_KERNEL (key) &&
+		    urf_device_is_software_blocked (URF_DEVICE (key)) != soft)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * urf_arbitrator_settle_expected:
+ *
+ * Forgets the pending write of @type once all its devices reported it.
+ **/
+static void
+urf_arbitrator_settle_expected (UrfArbitrator *arbitrator,
+				gint           type)
 {
 	UrfArbitratorPrivate *priv = arbitrator->priv;
-	int i = priv->block_index++;
-	struct fm_task_data *fm_data;
 
-	g_assert (priv->flight_mode_task);
+	if (priv->expected_soft[type] >= 0 &&
+	    urf_arbitrator_type_is_soft (arbitrator, type, priv->expected_soft[type]))
+		priv->expected_soft[type] = -1;
+}
 
-	fm_data = g_task_get_task_data (priv->flight_mode_task);
+/**
+ * urf_arbitrator_sync_block_cb:
+ *
+ * A failed write won't be echoed, so forget what we expected from it.
+ **/
+static void
+urf_arbitrator_sync_block_cb (GObject      *source,
+			      GAsyncResult *res,
+			      gpointer      user_data)
+{
+	UrfArbitrator *arbitrator = URF_ARBITRATOR (source);
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	gint type = GPOINTER_TO_INT (user_data);
+	gint block = GPOINTER_TO_INT (g_task_get_task_data (G_TASK (res)));
+	GError *error = NULL;
 
-	g_assert (fm_data);
+	g_task_propagate_pointer (G_TASK (res), &error);
+	g_object_unref (G_TASK (res));
 
-	fm_data->initial_state[i] = urf_killswitch_get_state (priv->killswitch[i]);
+	if (error != NULL) {
+		g_warning ("%s: syncing %s failed: %s", __func__,
+			   type_to_string (type), error->message);
+		g_error_free (error);
 
-	if (fm_data->initial_state[i] != KILLSWITCH_STATE_NO_ADAPTER) {
+		if (priv->expected_soft[type] == block)
+			priv->expected_soft[type] = -1;
+	} else {
+		urf_arbitrator_settle_expected (arbitrator, type);
+	}
+}
 
-		if (block || urf_config_get_prev_soft (priv->config, i))
-			fm_data->final_state[i] = TRUE;
-		else
-			fm_data->final_state[i] = FALSE;
+/**
+ * urf_arbitrator_sync_block_idx:
+ *
+ * Soft block or unblock a device on behalf of force_sync or persist.
+ * The kernel applies the write to every kernel device of the type, so
+ * nothing is written when those already have, or were already asked to
+ * get, that state. The CHANGE events the write causes are recognised
+ * in update_killswitch() and not acted upon again. The other devices
+ * only change themselves.
+ **/
+static void
+urf_arbitrator_sync_block_idx (UrfArbitrator *arbitrator,
+			       UrfDevice     *device,
+			       gboolean       block)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	gint index = urf_device_get_index (device);
+	gint type = urf_device_get_device_type (device);
+	gboolean done;
+	GTask *task;
+
+	if (URF_IS_DEVICE_KERNEL (device))
+		done = priv->expected_soft[type] == block ||
+		       (priv->expected_soft[type] < 0 &&
+			urf_arbitrator_type_is_soft (arbitrator, type, block));
+	else
+		done = urf_device_is_software_blocked (device) == block;
+
+	if (done) {
+		priv->suppressed_writes++;
+		g_debug ("device %d already %s, write suppressed (%u so far)",
+			 index, block ? "blocked" : "unblocked",
+			 priv->suppressed_writes);
+		return;
+	}
 
-		g_message ("%s: killswitch[%s] state: %s block: %u", __func__,
-			   type_to_string (i),
-			   state_to_string (fm_data->initial_state[i]),
-			   fm_data->final_state[i]);
+	if (!URF_IS_DEVICE_KERNEL (device)) {
+		urf_arbitrator_set_block_idx (arbitrator, index, block, NULL);
+		return;
+	}
 
-		priv->pending_block_task = g_task_new (arbitrator,
-						       NULL,
-						       urf_arbitrator_flight_mode_cb,
-						       GINT_TO_POINTER (i));
+	/* Only the kernel devices report our writes back */
+	priv->expected_soft[type] = block;
 
-		/* setting user_data in g_task_new () fails, so set here */
-		g_task_set_task_data (priv->pending_block_task, GINT_TO_POINTER (i), NULL);
+	task = g_task_new (arbitrator, NULL, urf_arbitrator_sync_block_cb,
+			   GINT_TO_POINTER (type));
+	g_task_set_task_data (task, GINT_TO_POINTER (block), NULL);
+	urf_arbitrator_set_block_idx (arbitrator, index, block, task);
+}
 
-		urf_arbitrator_set_block (arbitrator, i, fm_data->final_state[i], priv->pending_block_task);
+/**
+ * fm_task_data_free:
+ **/
+static void
+fm_task_data_free (struct fm_task_data *fm_data)
+{
+	if (fm_data->error)
+		g_error_free (fm_data->error);
+	if (fm_data->failed)
+		g_string_free (fm_data->failed, TRUE);
+	g_free (fm_data);
+}
 
-		/* indicates that a pending task has been created, so wait for cb */
-		return FALSE;
-	} else {
-		g_message ("%s: killswitch[%s] state: %s", __func__,
-			   type_to_string (i),
-			   state_to_string (fm_data->initial_state[i]));
+/**
+ * urf_arbitrator_flight_mode_complete:
+ **/
+static void
+urf_arbitrator_flight_mode_complete (UrfArbitrator *arbitrator,
+				     GTask         *task)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	struct fm_task_data *fm_data = g_task_get_task_data (task);
+	gboolean prev_soft;
+	int i;
+
+	if (fm_data->error != NULL) {
+		/*
+		 * If an error occurs for a single killswitch then use
+		 * initial_state array to restore killswitches that had
+		 * already been toggled
+		 */
+		for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+			if (!fm_data->done[i])
+				continue;
 
-		fm_data->final_state[i] = block;
+			g_debug ("restoring killswitch - %s", type_to_string (i));
+			urf_arbitrator_set_block (arbitrator, i, fm_data->initial_state[i], NULL);
+		}
 
-		/* indicates that no task has been created, so it can be called again */
-		return TRUE;
+		g_task_return_new_error (task,
+					 fm_data->error->domain,
+					 fm_data->error->code,
+					 "set_block failed: %s",
+					 fm_data->failed->str);
+		return;
 	}
+
+	g_message ("%s: flight-mode operation succeeded", __func__);
+
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		if (fm_data->block &&
+		    fm_data->initial_state[i] == KILLSWITCH_STATE_SOFT_BLOCKED)
+			prev_soft = TRUE;
+		else
+			prev_soft = FALSE;
+
+		urf_config_set_prev_soft (priv->config, i, prev_soft);
+
+		urf_config_set_persist_state (priv->config, i, fm_data->final_state[i] ?
+					      KILLSWITCH_STATE_SOFT_BLOCKED :
+					      KILLSWITCH_STATE_UNBLOCKED);
+	}
+
+	g_task_return_pointer (task, NULL, NULL);
 }
 
 /**
@@ -234,20 +418,16 @@ urf_arbitrator_flight_mode_cb (GObject *source,
 			       gpointer user_data)
 {
 	UrfArbitrator  *arbitrator;
-	UrfArbitratorPrivate *priv;
-	GError            *error = NULL;
-	int i;
+	GTask *task = G_TASK (user_data);
 	struct fm_task_data *fm_data;
+	GError *error = NULL;
+	int i;
 
 	g_assert (URF_IS_ARBITRATOR (source));
 	arbitrator = URF_ARBITRATOR (source);
 
-	priv = arbitrator->priv;
-
 	g_assert (g_task_is_valid (res, source));
-	g_assert (G_TASK (res) == G_TASK (priv->pending_block_task));
 
-	priv->pending_block_task = NULL;
 	i = GPOINTER_TO_INT (g_task_get_task_data (G_TASK (res)));
 
 	g_debug ("%s index: %d", __func__, i);
@@ -255,72 +435,29 @@ urf_arbitrator_flight_mode_cb (GObject *source,
 	g_task_propagate_pointer (G_TASK (res), &error);
 	g_object_unref (G_TASK (res));
 
-	g_assert (priv->flight_mode_task != NULL);
-	fm_data = g_task_get_task_data (priv->flight_mode_task);
-
+	fm_data = g_task_get_task_data (task);
 	g_assert (fm_data != NULL);
 
 	if (error != NULL) {
-		g_warning ("%s *error != NULL (Failed)", __func__);
-
-		/*
-		 * If an error occurs for a single killswitch then use
-		 * initial_state array to restore killswitches that had
-		 * already been toggled
-		 */
-
-		priv->block_index--;
-
-		for (i = RFKILL_TYPE_ALL + 1; i < priv->block_index; i++) {
-			g_debug ("restoring killswitch - %s", type_to_string (i));
+		g_warning ("%s: killswitch[%s] failed: %s", __func__,
+			   type_to_string (i), error->message);
 
-			if (fm_data->initial_state[i] != KILLSWITCH_STATE_NO_ADAPTER)
-				urf_arbitrator_set_block (arbitrator, i, fm_data->initial_state[i], NULL);
-			else
-				urf_config_set_persist_state (priv->config, i, fm_data->initial_state[i]);
-		}
-
-		g_task_return_new_error (priv->flight_mode_task,
-					 error->domain, error->code,
-					 "set_block failed: %s",
-					 type_to_string (i));
+		if (fm_data->failed->len > 0)
+			g_string_append (fm_data->failed, ", ");
+		g_string_append (fm_data->failed, type_to_string (i));
 
-		g_error_free (error);
-		error = NULL;
-
-		priv->flight_mode_task = NULL;
+		if (fm_data->error == NULL)
+			fm_data->error = error;
+		else
+			g_error_free (error);
 	} else {
-		g_debug ("%s: pending_block_task %s - SUCCESS; next_idx: %d", __func__,
-			 type_to_string (i), priv->block_index);
-
-		for (; priv->block_index < NUM_RFKILL_TYPES;)
-			if (!handle_flight_mode_killswitch(arbitrator, priv->pending_block))
-				break;
-
-		/* trigger flight_mode task if all killswitches have been processed */
-		if (priv->pending_block_task == NULL) {
-			gboolean prev_soft;
-
-			g_message ("%s: flight-mode operation succeeded", __func__);
-
-			for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
-				if (priv->pending_block &&
-				    fm_data->initial_state[i] == KILLSWITCH_STATE_SOFT_BLOCKED)
-					prev_soft = TRUE;
-				else
-					prev_soft = FALSE;
-
-				urf_config_set_prev_soft (priv->config, i, prev_soft);
-
-				urf_config_set_persist_state (priv->config, i, fm_data->final_state[i] ?
-							      KILLSWITCH_STATE_SOFT_BLOCKED :
-							      KILLSWITCH_STATE_UNBLOCKED);
-			}
-
-			g_task_return_pointer (priv->flight_mode_task, NULL, NULL);
-			priv->flight_mode_task = NULL;
-		}
+		g_debug ("%s: killswitch[%s] - SUCCESS", __func__, type_to_string (i));
+		fm_data->done[i] = TRUE;
 	}
+
+	g_assert (fm_data->pending > 0);
+	if (--fm_data->pending == 0)
+		urf_arbitrator_flight_mode_complete (arbitrator, task);
 }
 
 /**
@@ -332,41 +469,88 @@ urf_arbitrator_flight_mode (UrfArbitrator  *arbitrator,
 			    GTask *task)
 {
 	UrfArbitratorPrivate *priv = arbitrator->priv;
-	struct fm_task_data *fm_data = g_try_new0 (struct fm_task_data, 1);
+	struct fm_task_data *fm_data;
+	int i;
+
+	fm_data = g_try_new0 (struct fm_task_data, 1);
 	if (fm_data == NULL) {
 		g_message ("%s: out-of-memory", __func__);
-		g_task_return_new_error (priv->flight_mode_task,
+		g_task_return_new_error (task,
 					 URF_DAEMON_ERROR,
 					 URF_DAEMON_ERROR_GENERAL,
 					"out-of-memory");
 		return;
 	}
 
-	g_task_set_task_data (task, fm_data, g_free);
+	fm_data->block = block;
+	fm_data->failed = g_string_new (NULL);
+	g_task_set_task_data (task, fm_data, (GDestroyNotify) fm_task_data_free);
 
 	g_message ("%s: block: %d", __func__, (int) block);
 
-	priv->flight_mode_task = task;
-	priv->pending_block_task = NULL;
-	priv->pending_block = block;
+	/* Work out the target of every killswitch before starting any of
+	 * them, so the pending count is final when the first completes */
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		fm_data->initial_state[i] = urf_killswitch_get_state (priv->killswitch[i]);
 
-	for (priv->block_index = RFKILL_TYPE_ALL + 1;
-	     priv->block_index < NUM_RFKILL_TYPES;)
-		if (!handle_flight_mode_killswitch(arbitrator, block))
-			break;
+		if (fm_data->initial_state[i] == KILLSWITCH_STATE_NO_ADAPTER) {
+			fm_data->final_state[i] = block;
+		} else {
+			if (block || urf_config_get_prev_soft (priv->config, i))
+				fm_data->final_state[i] = TRUE;
+			else
+				fm_data->final_state[i] = FALSE;
 
-	g_debug ("%s: handle_flight_mode_killswitch returned FALSE", __func__);
+			fm_data->pending++;
+		}
+
+		g_message ("%s: killswitch[%s] state: %s block: %u", __func__,
+			   type_to_string (i),
+			   state_to_string (fm_data->initial_state[i]),
+			   fm_data->final_state[i]);
+	}
 
 	/* handle case where all adapters are missing */
-	if (priv->pending_block_task == NULL && priv->flight_mode_task != NULL) {
-			g_debug ("%s: no pending_block_task - firing fm_task", __func__);
+	if (fm_data->pending == 0) {
+		g_debug ("%s: no adapters - firing fm_task", __func__);
+		g_task_return_pointer (task, NULL, NULL);
+		return;
+	}
 
-			g_task_return_pointer (priv->flight_mode_task, NULL, NULL);
+	/* Every killswitch is blocked at once; the flight-mode task is
+	 * completed when the last one reports back */
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		GTask *block_task;
 
-			priv->flight_mode_task = NULL;
+		if (fm_data->initial_state[i] == KILLSWITCH_STATE_NO_ADAPTER)
+			continue;
+
+		block_task = g_task_new (arbitrator,
+					 NULL,
+					 urf_arbitrator_flight_mode_cb,
+					 task);
+		g_task_set_task_data (block_task, GINT_TO_POINTER (i), NULL);
+
+		urf_arbitrator_set_block (arbitrator, i, fm_data->final_state[i], block_task);
 	}
 }
 
+/**
+ * urf_arbitrator_get_killswitch:
+ *
+ * Return value: (transfer none): the killswitch of @type, or %NULL for
+ *               RFKILL_TYPE_ALL
+ **/
+UrfKillswitch *
+urf_arbitrator_get_killswitch (UrfArbitrator *arbitrator,
+			       gint           type)
+{
+	g_return_val_if_fail (URF_IS_ARBITRATOR (arbitrator), NULL);
+	g_return_val_if_fail (type >= 0 && type < NUM_RFKILL_TYPES, NULL);
+
+	return arbitrator->priv->killswitch[type];
+}
+
 /**
  * urf_arbitrator_get_state:
  **/
@@ -409,7 +593,7 @@ urf_arbitrator_get_state_idx (UrfArbitrator *arbitrator,
 
 	priv = arbitrator->priv;
 
-	if (priv->devices == NULL)
+	if (g_queue_is_empty (&priv->devices))
 		return state;
 
 	device = urf_arbitrator_find_device (arbitrator, index);
@@ -443,12 +627,12 @@ urf_arbitrator_add_device (UrfArbitrator *arbitrator, UrfDevice *device)
 	type = urf_device_get_device_type (device);
 	soft = urf_device_is_software_blocked (device);
 
-	priv->devices = g_list_append (priv->devices, device);
+	urf_arbitrator_index_device (arbitrator, device);
 
 	urf_killswitch_add_device (priv->killswitch[type], device);
 
 	if (priv->force_sync && !urf_device_is_platform (device)) {
-		urf_arbitrator_set_block_idx (arbitrator, index, soft, NULL);
+		urf_arbitrator_sync_block_idx (arbitrator, device, soft);
 	}
 
 	if (priv->persist) {
@@ -460,7 +644,7 @@ urf_arbitrator_add_device (UrfArbitrator *arbitrator, UrfDevice *device)
 		 * to the persistence file.
 		 */
 		soft = urf_config_get_persist_state (priv->config, type);
-		urf_arbitrator_set_block_idx (arbitrator, index, soft, NULL);
+		urf_arbitrator_sync_block_idx (arbitrator, device, soft);
 	}
 
 	g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_ADDED], 0,
@@ -489,7 +673,7 @@ urf_arbitrator_remove_device (UrfArbitrator *arbitrator, UrfDevice *device)
 
 	g_return_val_if_fail (type >= 0, FALSE);
 
-	arbitrator->priv->devices = g_list_remove (arbitrator->priv->devices, device);
+	urf_arbitrator_unindex_device (arbitrator, device);
 
 	/* killswitch_del_device unrefs the device, so we make a copy of the path */
 	object_path = g_strdup (urf_device_get_object_path (device));
@@ -512,7 +696,7 @@ urf_arbitrator_has_devices (UrfArbitrator *arbitrator)
 {
 	g_return_val_if_fail (URF_IS_ARBITRATOR (arbitrator), FALSE);
 
-	return (arbitrator->priv->devices != NULL);
+	return !g_queue_is_empty (&arbitrator->priv->devices);
 }
 
 /**
@@ -523,7 +707,7 @@ urf_arbitrator_get_devices (UrfArbitrator *arbitrator)
 {
 	g_return_val_if_fail (URF_IS_ARBITRATOR (arbitrator), NULL);
 
-	return arbitrator->priv->devices;
+	return arbitrator->priv->devices.head;
 }
 
 /**
@@ -557,6 +741,7 @@ update_killswitch (UrfArbitrator *arbitrator,
 	UrfArbitratorPrivate *priv = arbitrator->priv;
 	UrfDevice *device;
 	gboolean changed, old_hard = FALSE;
+	gboolean echo = FALSE;
 	char *object_path;
 	gint type;
 
@@ -568,9 +753,25 @@ update_killswitch (UrfArbitrator *arbitrator,
 		return;
 	}
 
+	/* An event matching the pending write of the type is its echo,
+	 * any other one means the type went elsewhere */
+	type = urf_device_get_device_type (device);
+	if (priv->expected_soft[type] >= 0) {
+		if (priv->expected_soft[type] == soft) {
+			echo = TRUE;
+			priv->suppressed_echoes++;
+			g_debug ("event of device %d echoes our write (%u so far)",
+				 index, priv->suppressed_echoes);
+		} else {
+			priv->expected_soft[type] = -1;
+		}
+	}
+
 	old_hard = urf_device_is_hardware_blocked (device);
 
 	changed = urf_device_update_states (device, soft, hard);
+	if (echo)
+		urf_arbitrator_settle_expected (arbitrator, type);
 
 	if (changed == TRUE) {
 		g_debug ("updating killswitch status %d to soft %d hard %d",
@@ -579,14 +780,15 @@ update_killswitch (UrfArbitrator *arbitrator,
 		g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_CHANGED], 0, object_path);
 		g_free (object_path);
 
+		/* Echoes still have to honour the hard block, but their
+		 * state was the one we persisted in the first place */
 		if (priv->force_sync) {
 			/* Sync soft and hard blocks */
 			if (hard == TRUE && soft == FALSE)
-				urf_arbitrator_set_block_idx (arbitrator, index, TRUE, NULL);
+				urf_arbitrator_sync_block_idx (arbitrator, device, TRUE);
 			else if (hard != old_hard && hard == FALSE)
-				urf_arbitrator_set_block_idx (arbitrator, index, FALSE, NULL);
-		} else {
-			type = urf_device_get_device_type (device);
+				urf_arbitrator_sync_block_idx (arbitrator, device, FALSE);
+		} else if (!echo) {
 			urf_config_set_persist_state (priv->config, type, soft);
 		}
 	}
@@ -602,7 +804,6 @@ remove_killswitch (UrfArbitrator *arbitrator,
 	UrfArbitratorPrivate *priv = arbitrator->priv;
 	UrfDevice *device;
 	gint type;
-	const char *name;
 	char *object_path = NULL;
 
 	g_return_if_fail (index >= 0);
@@ -613,12 +814,13 @@ remove_killswitch (UrfArbitrator *arbitrator,
 		return;
 	}
 
-	priv->devices = g_list_remove (priv->devices, device);
+	urf_arbitrator_unindex_device (arbitrator, device);
 	type = urf_device_get_device_type (device);
+	urf_arbitrator_settle_expected (arbitrator, type);
 	object_path = g_strdup (urf_device_get_object_path(device));
 
-	name = urf_device_get_name (device);
-	g_message ("removing killswitch idx %d %s", index, name);
+	/* sysfs is already gone, so don't look the name up now */
+	g_message ("removing killswitch idx %d %s", index, object_path);
 
 	urf_killswitch_del_device (priv->killswitch[type], device);
 	g_object_unref (device);
@@ -638,10 +840,13 @@ add_killswitch (UrfArbitrator *arbitrator,
 		gboolean       hard)
 
 {
+	UrfArbitratorPrivate *priv = arbitrator->priv;
 	UrfDevice *device;
+	RfkillDeviceInfo *info = NULL;
 
 	g_return_if_fail (index >= 0);
 	g_return_if_fail (type >= 0);
+	g_return_if_fail (priv->batch != NULL);
 
 	device = urf_arbitrator_find_device (arbitrator, index);
 	if (device != NULL) {
@@ -652,7 +857,14 @@ add_killswitch (UrfArbitrator *arbitrator,
 	g_message ("adding killswitch type %d idx %d soft %d hard %d",
 		   type, index, soft, hard);
 
-	device = urf_device_kernel_new (index, type, soft, hard);
+	if (priv->startup_info) {
+		info = g_hash_table_lookup (priv->startup_info,
+					    GINT_TO_POINTER (index));
+		if (info)
+			priv->startup_hits++;
+	}
+
+	device = urf_device_kernel_new (index, type, soft, hard, priv->batch, info);
 
 	urf_arbitrator_add_device (arbitrator, device);
 }
@@ -693,54 +905,96 @@ static inline gboolean is_hybris_type(UrfArbitrator *arbitrator, int type)
 }
 #endif /* HAS_HYBRIS */
 
-static GIOStatus
-process_event(UrfArbitrator *arbitrator)
+/**
+ * process_event:
+ **/
+static void
+process_event (UrfArbitrator       *arbitrator,
+	       struct rfkill_event *event)
 {
-	UrfArbitratorPrivate *priv = arbitrator->priv;
-	GIOStatus status;
-	struct rfkill_event event;
-	gsize read;
 	gboolean soft, hard;
 
-	memset(&event, 0, sizeof(event));
-
-	status = g_io_channel_read_chars (priv->channel,
-					  (char *) &event,
-					  sizeof(event),
-					  &read,
-					  NULL);
-
-	if (status != G_IO_STATUS_NORMAL)
-		return status;
-
-	if (read != sizeof(event))
-		return status;
-
-	print_event (&event);
+	print_event (event);
 
 #ifdef HAS_HYBRIS
-	if (is_hybris_type (arbitrator, event.type)) {
+	if (is_hybris_type (arbitrator, event->type)) {
 		g_debug("Ignoring rfkill event as rfkill is managed by hybris");
-		return status;
+		return;
 	}
 #endif
 
-	soft = (event.soft > 0);
-	hard = (event.hard > 0);
+	soft = (event->soft > 0);
+	hard = (event->hard > 0);
 
-	switch (event.op) {
+	switch (event->op) {
 	case RFKILL_OP_CHANGE:
-		update_killswitch (arbitrator, event.idx, soft, hard);
+		update_killswitch (arbitrator, event->idx, soft, hard);
 		break;
 	case RFKILL_OP_DEL:
-		remove_killswitch (arbitrator, event.idx);
+		remove_killswitch (arbitrator, event->idx);
 		break;
 	case RFKILL_OP_ADD:
-		add_killswitch (arbitrator, event.idx, event.type, soft, hard);
+		add_killswitch (arbitrator, event->idx, event->type, soft, hard);
 		break;
 	default:
 		break;
 	}
+}
+
+/**
+ * read_events:
+ *
+ * Reads from /dev/rfkill once and processes every event returned.
+ **/
+static GIOStatus
+read_events (UrfArbitrator *arbitrator)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	struct rfkill_event buf[RFKILL_EVENT_BATCH];
+	struct rfkill_event event;
+	GIOStatus status;
+	gsize read;
+	guint i;
+
+	status = g_io_channel_read_chars (priv->channel,
+					  (char *) buf,
+					  sizeof(buf),
+					  &read,
+					  NULL);
+
+	if (status != G_IO_STATUS_NORMAL)
+		return status;
+
+	if (read < RFKILL_EVENT_SIZE_V1)
+		return status;
+
+	if (read % sizeof(struct rfkill_event) == 0) {
+		for (i = 0; i < read / sizeof(struct rfkill_event); i++)
+			process_event (arbitrator, &buf[i]);
+	} else {
+		/* The kernel's event is smaller (RFKILL_EVENT_SIZE_V1) or
+		 * larger than ours; use the fields we know about */
+		memset (&event, 0, sizeof(event));
+		memcpy (&event, buf, MIN (read, sizeof(event)));
+		process_event (arbitrator, &event);
+	}
+
+	return status;
+}
+
+/**
+ * drain_events:
+ *
+ * Processes every event available without going back to the main loop.
+ **/
+static GIOStatus
+drain_events (UrfArbitrator *arbitrator)
+{
+	GIOStatus status;
+
+	do {
+		status = read_events (arbitrator);
+	} while (status == G_IO_STATUS_NORMAL);
 
 	return status;
 }
@@ -756,9 +1010,9 @@ event_cb (GIOChannel    *source,
 	if (condition & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
 		return FALSE;
 
-	/* Process next event. GLib will call us repeatedly for anymore
-	 * available events. */
-	if (process_event (arbitrator) == G_IO_STATUS_ERROR)
+	/* A burst of events (startup, dock/undock, our own CHANGE_ALL
+	 * writes) is handled in a single wakeup */
+	if (drain_events (arbitrator) == G_IO_STATUS_ERROR)
 		return FALSE;
 
 	return TRUE;
@@ -785,6 +1039,8 @@ urf_arbitrator_startup (UrfArbitrator *arbitrator,
 			UrfConfig     *config)
 {
 	UrfArbitratorPrivate *priv = arbitrator->priv;
+	struct udev *udev;
+	GTimer *timer;
 	int fd;
 
 	priv->config = g_object_ref (config);
@@ -816,13 +1072,44 @@ urf_arbitrator_startup (UrfArbitrator *arbitrator,
 
 		priv->fd = fd;
 
+		/* Kernel devices share this descriptor for writes. Those of
+		 * the same type or, when they all agree, of every type are
+		 * blocked with a single write */
+#ifdef HAS_HYBRIS
+		priv->batch = urf_kernel_batch_new (priv->fd, !priv->hybris_wlan);
+#else
+		priv->batch = urf_kernel_batch_new (priv->fd, TRUE);
+#endif /* HAS_HYBRIS */
+
 		priv->channel = g_io_channel_unix_new (priv->fd);
 		g_io_channel_set_encoding (priv->channel, NULL, NULL);
 		g_io_channel_set_buffered (priv->channel, FALSE);
 
+		/* Look up the udev attributes of all the devices reported
+		 * by the initial ADD events in a single enumeration */
+		timer = g_timer_new ();
+		udev = get_udev_context ();
+		if (udev)
+			priv->startup_info = get_rfkill_device_info (udev);
+
 		/* Process all available events first to sync our state
 		 * now rather than doing it somewhere in the future */
-		while (process_event(arbitrator) == G_IO_STATUS_NORMAL);
+		drain_events (arbitrator);
+
+		g_debug ("Startup scan: %u devices in %.3f ms, %u of %u resolved by a single udev enumeration",
+			 g_queue_get_length (&priv->devices),
+			 g_timer_elapsed (timer, NULL) * 1000.0,
+			 priv->startup_hits,
+			 priv->startup_info ? g_hash_table_size (priv->startup_info) : 0);
+		g_timer_destroy (timer);
+
+		if (priv->startup_info) {
+			g_hash_table_destroy (priv->startup_info);
+			priv->startup_info = NULL;
+		}
+
+		g_debug ("%u rfkill fds saved by the shared descriptor",
+			 urf_kernel_batch_get_fds_saved (priv->batch));
 
 		priv->watch_id = g_io_add_watch (priv->channel,
 		                                 G_IO_IN | G_IO_HUP | G_IO_ERR,
@@ -849,9 +1136,15 @@ urf_arbitrator_init (UrfArbitrator *arbitrator)
 	int i;
 
 	arbitrator->priv = priv;
-	priv->devices = NULL;
+	g_queue_init (&priv->devices);
+	priv->device_index = g_hash_table_new (g_direct_hash, g_direct_equal);
 	priv->fd = -1;
 
+	for (i = 0; i < NUM_RFKILL_TYPES; i++) {
+		priv->type_devices[i] = g_hash_table_new (g_direct_hash, g_direct_equal);
+		priv->expected_soft[i] = -1;
+	}
+
 	priv->killswitch[RFKILL_TYPE_ALL] = NULL;
 	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++)
 		priv->killswitch[i] = urf_killswitch_new (i);
@@ -873,10 +1166,22 @@ urf_arbitrator_dispose (GObject *object)
 		}
 	}
 
-	if (priv->devices) {
-		g_list_foreach (priv->devices, (GFunc) g_object_unref, NULL);
-		g_list_free (priv->devices);
-		priv->devices = NULL;
+	if (priv->device_index) {
+		g_hash_table_destroy (priv->device_index);
+		priv->device_index = NULL;
+
+		for (i = 0; i < NUM_RFKILL_TYPES; i++) {
+			g_hash_table_destroy (priv->type_devices[i]);
+			priv->type_devices[i] = NULL;
+		}
+	}
+
+	g_queue_foreach (&priv->devices, (GFunc) g_object_unref, NULL);
+	g_queue_clear (&priv->devices);
+
+	if (priv->batch) {
+		g_object_unref (priv->batch);
+		priv->batch = NULL;
 	}
 
 	if (priv->config) {
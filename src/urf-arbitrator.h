@@ -27,6 +27,7 @@
 
 #include "urf-config.h"
 #include "urf-device.h"
+#include "urf-killswitch.h"
 #include "urf-utils.h"
 
 G_BEGIN_DECLS
@@ -86,6 +87,8 @@ void			 urf_arbitrator_set_block_idx		(UrfArbitrator	*arbitrator,
 void		         urf_arbitrator_flight_mode		(UrfArbitrator	*arbitrator,
 								 const gboolean	 block,
 								 GTask          *task);
+UrfKillswitch		*urf_arbitrator_get_killswitch		(UrfArbitrator	*arbitrator,
+								 gint		 type);
 KillswitchState		 urf_arbitrator_get_state		(UrfArbitrator	*arbitrator,
 								 gint 		 type);
 KillswitchState		 urf_arbitrator_get_state_idx		(UrfArbitrator	*arbitrator,
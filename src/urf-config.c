@@ -29,10 +29,13 @@
 #include <sys/stat.h>
 #include "urf-utils.h"
 #include "urf-config.h"
+#include "urf-state-store.h"
 
 #define URFKILL_PROFILE_DIR URFKILL_CONFIG_DIR"profile/"
 #define URFKILL_CONFIGURED_PROFILE URFKILL_CONFIG_DIR"hardware.conf"
 #define URFKILL_PERSISTENCE_FILENAME PACKAGE_LOCALSTATE_DIR "/lib/urfkill/saved-states"
+#define URFKILL_STATE_STORE_FILENAME PACKAGE_LOCALSTATE_DIR "/lib/urfkill/saved-states.bin"
+#define URFKILL_PERSIST_DELAY_DEFAULT 1000
 
 enum
 {
@@ -45,11 +48,26 @@ enum
 	OPT_UNKNOWN,
 };
 
+#define NUM_OPTIONS OPT_UNKNOWN
+
+enum
+{
+	MATCH_KEY_SYS_VENDOR,
+	MATCH_KEY_BIOS_DATE,
+	MATCH_KEY_BIOS_VENDOR,
+	MATCH_KEY_BIOS_VERSION,
+	MATCH_KEY_PRODUCT_NAME,
+	MATCH_KEY_PRODUCT_VERSION,
+	MATCH_KEY_UNKNOWN,
+};
+
+#define NUM_MATCH_KEYS MATCH_KEY_UNKNOWN
+
 enum
 {
-	OPT_TYPE_NONE,
-	OPT_TYPE_BOOLEAN,
-	OPT_TYPE_UNKNOWN,
+	MATCH_RESULT_UNKNOWN,
+	MATCH_RESULT_TRUE,
+	MATCH_RESULT_FALSE,
 };
 
 enum
@@ -77,13 +95,44 @@ typedef struct {
 	gboolean strict_flight_mode;
 } Options;
 
+/* A compiled <match> element */
 typedef struct {
-	int	 xml_depth;
-	int	 xml_bound;
-	int	 opt;
-	int	 opt_type;
-	Options	 options;
-	DmiInfo	*hardware_info;
+	int	  key;		/* MATCH_KEY_* */
+	int	  operator;	/* OPER_* */
+	char	 *body;
+	char	 *body_lower;	/* for the _ncase operators */
+	char	**tokens;	/* non-empty tokens for the _outof operators */
+	int	  result;	/* MATCH_RESULT_* of the current evaluation */
+} MatchCond;
+
+/* A compiled <option> with the <match> elements enclosing it */
+typedef struct {
+	GPtrArray *conds;	/* MatchCond, outermost first, minus the vendor */
+	MatchCond *vendor;	/* outermost sys_vendor match, if any */
+	int	   opt;
+	gboolean   value;
+	guint	   seq;		/* document order across all profiles */
+} ProfileRule;
+
+/* Rules sharing the same sys_vendor match */
+typedef struct {
+	MatchCond *vendor;	/* NULL for rules not qualified by sys_vendor */
+	GPtrArray *rules;
+} RuleBucket;
+
+typedef struct {
+	GPtrArray  *conds;	/* owns every MatchCond */
+	GPtrArray  *buckets;	/* RuleBucket, in order of first appearance */
+	GHashTable *vendor_buckets; /* "operator:body" -> RuleBucket */
+	guint	    n_rules;
+} ProfileTable;
+
+typedef struct {
+	GPtrArray *stack;	/* MatchCond or NULL for each open element */
+	GPtrArray *conds;
+	GPtrArray *rules;
+	int	   opt;
+	GString	  *cdata;
 } ParseInfo;
 
 #define URF_CONFIG_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
@@ -92,12 +141,18 @@ struct UrfConfigPrivate {
 	char 	*user;
 	Options	 options;
 	GKeyFile *persistence_file;
+	char	*persistence_data; /* content last loaded or written */
+	guint	 persist_delay;
+	guint	 persist_save_id;
+	UrfStateStore *state_store; /* set when persist_format=binary */
 };
 
 G_DEFINE_TYPE(UrfConfig, urf_config, G_TYPE_OBJECT)
 
 static gpointer urf_config_object = NULL;
 
+static void urf_config_set_persist_format (UrfConfig *config, const char *format);
+
 static int
 get_option (const char *option)
 {
@@ -115,33 +170,21 @@ get_option (const char *option)
 }
 
 static int
-get_option_type (const char *type)
-{
-	if (g_strcmp0 (type, "bool") == 0)
-		return OPT_TYPE_BOOLEAN;
-	return OPT_TYPE_UNKNOWN;
-}
-
-static char *
-get_match_key (DmiInfo    *hardware_info,
-	       const char *key)
+get_match_key (const char *key)
 {
-	if (hardware_info == NULL)
-		return NULL;
-
 	if (g_strcmp0 (key, "sys_vendor") == 0)
-		return hardware_info->sys_vendor;
+		return MATCH_KEY_SYS_VENDOR;
 	else if (g_strcmp0 (key, "bios_date") == 0)
-		return hardware_info->bios_date;
+		return MATCH_KEY_BIOS_DATE;
 	else if (g_strcmp0 (key, "bios_vendor") == 0)
-		return hardware_info->bios_vendor;
+		return MATCH_KEY_BIOS_VENDOR;
 	else if (g_strcmp0 (key, "bios_version") == 0)
-		return hardware_info->bios_version;
+		return MATCH_KEY_BIOS_VERSION;
 	else if (g_strcmp0 (key, "product_name") == 0)
-		return hardware_info->product_name;
+		return MATCH_KEY_PRODUCT_NAME;
 	else if (g_strcmp0 (key, "product_version") == 0)
-		return hardware_info->product_version;
-	return NULL;
+		return MATCH_KEY_PRODUCT_VERSION;
+	return MATCH_KEY_UNKNOWN;
 }
 
 static int
@@ -174,170 +217,220 @@ get_operator (const char *operator)
 	return OPER_UNKNOWN;
 }
 
-static gboolean
-match_rule (const char *str1,
-	    const int   operator,
-	    const char *str2)
+static MatchCond *
+match_cond_new (int         key,
+		int         operator,
+		const char *body)
 {
-	gboolean match = FALSE;
+	MatchCond *cond;
 	char **token;
-	char *str1_lower;
-	char *str2_lower;
+	GPtrArray *tokens;
 	int i;
 
-	if (strlen (str1) < 1 || strlen (str2) < 1)
-		return FALSE;
+	cond = g_new0 (MatchCond, 1);
+	cond->key = key;
+	cond->operator = operator;
+	cond->body = g_strdup (body ? body : "");
 
 	switch (operator) {
-	case OPER_STRING:
-		if (g_strcmp0 (str1, str2) == 0)
-			match = TRUE;
+	case OPER_CONTAINS_NCASE:
+	case OPER_PREFIX_NCASE:
+	case OPER_SUFFIX_NCASE:
+		cond->body_lower = g_ascii_strdown (cond->body, -1);
 		break;
 	case OPER_STRING_OUTOF:
-		token = g_strsplit (str2, ";", 0);
+	case OPER_CONTAINS_OUTOF:
+	case OPER_PREFIX_OUTOF:
+	case OPER_SUFFIX_OUTOF:
+		token = g_strsplit (cond->body, ";", 0);
+		tokens = g_ptr_array_new ();
 		for (i = 0; token[i]; i++) {
-			if (g_strcmp0 (str1, token[i]) == 0) {
-				match = TRUE;
-				break;
-			}
+			if (strlen (token[i]) < 1)
+				g_free (token[i]);
+			else
+				g_ptr_array_add (tokens, token[i]);
 		}
-		g_strfreev (token);
+		g_ptr_array_add (tokens, NULL);
+		g_free (token);
+		cond->tokens = (char **) g_ptr_array_free (tokens, FALSE);
 		break;
-	case OPER_CONTAINS:
-		if (g_strrstr (str1, str2))
-			match = TRUE;
+	default:
 		break;
+	}
+
+	return cond;
+}
+
+static void
+match_cond_free (MatchCond *cond)
+{
+	g_free (cond->body);
+	g_free (cond->body_lower);
+	g_strfreev (cond->tokens);
+	g_free (cond);
+}
+
+static void
+profile_rule_free (ProfileRule *rule)
+{
+	g_ptr_array_unref (rule->conds);
+	g_free (rule);
+}
+
+static void
+rule_bucket_free (RuleBucket *bucket)
+{
+	g_ptr_array_unref (bucket->rules);
+	g_free (bucket);
+}
+
+static gboolean
+match_rule (const MatchCond *cond,
+	    const char      *str,
+	    const char      *str_lower)
+{
+	int i;
+
+	if (strlen (str) < 1 || strlen (cond->body) < 1)
+		return FALSE;
+
+	switch (cond->operator) {
+	case OPER_STRING:
+		return g_strcmp0 (str, cond->body) == 0;
+	case OPER_STRING_OUTOF:
+		for (i = 0; cond->tokens[i]; i++) {
+			if (g_strcmp0 (str, cond->tokens[i]) == 0)
+				return TRUE;
+		}
+		return FALSE;
+	case OPER_CONTAINS:
+		return strstr (str, cond->body) != NULL;
 	case OPER_CONTAINS_NCASE:
-		str1_lower = g_ascii_strdown (str1, -1);
-		str2_lower = g_ascii_strdown (str2, -1);
-		if (g_strrstr (str1_lower, str2_lower))
-			match = TRUE;
-		g_free (str1_lower);
-		g_free (str2_lower);
-		break;
+		return strstr (str_lower, cond->body_lower) != NULL;
 	case OPER_CONTAINS_NOT:
-		if (g_strrstr (str1, str2) == NULL)
-			match = TRUE;
-		break;
+		return strstr (str, cond->body) == NULL;
 	case OPER_CONTAINS_OUTOF:
-		token = g_strsplit (str2, ";", 0);
-		for (i = 0; token[i]; i++) {
-			if (strlen (token[i]) < 1) {
-				continue;
-			} else if (g_strrstr (str1, token[i])) {
-				match = TRUE;
-				break;
-			}
+		for (i = 0; cond->tokens[i]; i++) {
+			if (strstr (str, cond->tokens[i]))
+				return TRUE;
 		}
-		g_strfreev (token);
-		break;
+		return FALSE;
 	case OPER_PREFIX:
-		if (g_str_has_prefix (str1, str2))
-			match = TRUE;
-		break;
+		return g_str_has_prefix (str, cond->body);
 	case OPER_PREFIX_NCASE:
-		str1_lower = g_ascii_strdown (str1, -1);
-		str2_lower = g_ascii_strdown (str2, -1);
-		if (g_str_has_prefix (str1_lower, str2_lower))
-			match = TRUE;
-		g_free (str1_lower);
-		g_free (str2_lower);
-		break;
+		return g_str_has_prefix (str_lower, cond->body_lower);
 	case OPER_PREFIX_OUTOF:
-		token = g_strsplit (str2, ";", 0);
-		for (i = 0; token[i]; i++) {
-			if (strlen (token[i]) < 1) {
-				continue;
-			} else if (g_str_has_prefix (str1, token[i])) {
-				match = TRUE;
-				break;
-			}
+		for (i = 0; cond->tokens[i]; i++) {
+			if (g_str_has_prefix (str, cond->tokens[i]))
+				return TRUE;
 		}
-		g_strfreev (token);
-		break;
+		return FALSE;
 	case OPER_SUFFIX:
-		if (g_str_has_suffix (str1, str2))
-			match = TRUE;
-		break;
+		return g_str_has_suffix (str, cond->body);
 	case OPER_SUFFIX_NCASE:
-		str1_lower = g_ascii_strdown (str1, -1);
-		str2_lower = g_ascii_strdown (str2, -1);
-		if (g_str_has_suffix (str1_lower, str2_lower))
-			match = TRUE;
-		g_free (str1_lower);
-		g_free (str2_lower);
-		break;
+		return g_str_has_suffix (str_lower, cond->body_lower);
 	case OPER_SUFFIX_OUTOF:
-		token = g_strsplit (str2, ";", 0);
-		for (i = 0; token[i]; i++) {
-			if (strlen (token[i]) < 1) {
-				continue;
-			} else if (g_str_has_suffix (str1, token[i])) {
-				match = TRUE;
-				break;
-			}
+		for (i = 0; cond->tokens[i]; i++) {
+			if (g_str_has_suffix (str, cond->tokens[i]))
+				return TRUE;
 		}
-		g_strfreev (token);
-		break;
+		return FALSE;
 	default:
-		match = FALSE;
-		break;
+		return FALSE;
 	}
+}
+
+/**
+ * match_cond_eval:
+ *
+ * Conditions are shared by every rule nested below them, so the result
+ * is remembered for the duration of one profile_table_apply().
+ **/
+static gboolean
+match_cond_eval (MatchCond   *cond,
+		 const char **values,
+		 char       **lower)
+{
+	gboolean match;
+
+	if (cond->result != MATCH_RESULT_UNKNOWN)
+		return cond->result == MATCH_RESULT_TRUE;
+
+	/* A key missing from the DMI information doesn't rule out a match */
+	if (values[cond->key] == NULL)
+		match = TRUE;
+	else
+		match = match_rule (cond, values[cond->key], lower[cond->key]);
+
+	cond->result = match ? MATCH_RESULT_TRUE : MATCH_RESULT_FALSE;
 
 	return match;
 }
 
+static ProfileTable *
+profile_table_new (void)
+{
+	ProfileTable *table;
+
+	table = g_new0 (ProfileTable, 1);
+	table->conds = g_ptr_array_new_with_free_func ((GDestroyNotify) match_cond_free);
+	table->buckets = g_ptr_array_new_with_free_func ((GDestroyNotify) rule_bucket_free);
+	table->vendor_buckets = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, NULL);
+
+	return table;
+}
+
+static void
+profile_table_free (ProfileTable *table)
+{
+	g_hash_table_destroy (table->vendor_buckets);
+	g_ptr_array_unref (table->buckets);
+	g_ptr_array_unref (table->conds);
+	g_free (table);
+}
+
+static void
+profile_table_add_rule (ProfileTable *table,
+			ProfileRule  *rule)
+{
+	RuleBucket *bucket;
+	char *bucket_key;
+
+	if (rule->vendor)
+		bucket_key = g_strdup_printf ("%d:%s", rule->vendor->operator,
+					      rule->vendor->body);
+	else
+		bucket_key = g_strdup ("");
+
+	bucket = g_hash_table_lookup (table->vendor_buckets, bucket_key);
+	if (bucket == NULL) {
+		bucket = g_new0 (RuleBucket, 1);
+		bucket->vendor = rule->vendor;
+		bucket->rules = g_ptr_array_new_with_free_func ((GDestroyNotify) profile_rule_free);
+		g_ptr_array_add (table->buckets, bucket);
+		g_hash_table_insert (table->vendor_buckets, bucket_key, bucket);
+	} else {
+		g_free (bucket_key);
+	}
+
+	rule->seq = ++table->n_rules;
+	g_ptr_array_add (bucket->rules, rule);
+}
+
 static void
 parse_xml_cdata_handler (void       *data,
 			 const char *cdata,
 			 int         len)
 {
 	ParseInfo *info = (ParseInfo *)data;
-	char *str;
 
 	if (info->opt == OPT_NONE ||
 	    info->opt == OPT_UNKNOWN) {
 		return;
 	}
 
-	str = g_strndup (cdata, len);
-
-	switch (info->opt) {
-	case OPT_KEY_CONTROL:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.key_control = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.key_control = FALSE;
-		break;
-	case OPT_MASTER_KEY:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.master_key = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.master_key = FALSE;
-		break;
-	case OPT_FORCE_SYNC:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.force_sync = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.force_sync = FALSE;
-		break;
-	case OPT_PERSIST:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.persist = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.persist = FALSE;
-		break;
-	case OPT_STRICT_FLIGHT_MODE:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.strict_flight_mode = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.strict_flight_mode = FALSE;
-		break;
-	default:
-		break;
-	}
-
-	g_free (str);
+	g_string_append_len (info->cdata, cdata, len);
 }
 
 static void
@@ -346,22 +439,15 @@ parse_xml_start_element (void       *data,
 			 const char **atts)
 {
 	ParseInfo *info = (ParseInfo *)data;
+	MatchCond *cond = NULL;
 	const char *key = NULL;
-	const char *type = NULL;
-	const char *match_key = NULL;
 	const char *match_body = NULL;
-	int operator = 0;
+	int operator = OPER_UNKNOWN;
+	int op;
+	int match_key;
 	int i;
 
-	info->xml_depth++;
-
-	if (info->xml_depth > info->xml_bound)
-		return;
-	else if (info->xml_depth < info->xml_bound)
-		info->xml_bound = info->xml_depth + 1;
-
 	info->opt = OPT_NONE;
-	info->opt_type = OPT_TYPE_NONE;
 
 	if (g_strcmp0 (name, "match") == 0) {
 		for (i = 0; atts[i]; i++) {
@@ -370,17 +456,21 @@ parse_xml_start_element (void       *data,
 					continue;
 				key = atts[i+1];
 				i++;
-			} else if ((operator = get_operator (atts[i])) != OPER_UNKNOWN) {
+			} else if ((op = get_operator (atts[i])) != OPER_UNKNOWN) {
 				if (!atts[i+1])
 					continue;
+				operator = op;
 				match_body = atts[i+1];
 				i++;
 			}
 		}
 
-		match_key = get_match_key (info->hardware_info, key);
-		if (match_key && !match_rule (match_key, operator, match_body))
-			return;
+		/* Unknown keys never exclude the nested options */
+		match_key = get_match_key (key);
+		if (match_key != MATCH_KEY_UNKNOWN) {
+			cond = match_cond_new (match_key, operator, match_body);
+			g_ptr_array_add (info->conds, cond);
+		}
 	} else if (g_strcmp0 (name, "option") == 0) {
 		for (i = 0; atts[i]; i++) {
 			if (g_strcmp0 (atts[i], "key") == 0) {
@@ -388,19 +478,14 @@ parse_xml_start_element (void       *data,
 					continue;
 				key = atts[i+1];
 				i++;
-			} else if (g_strcmp0 (atts[i], "type") == 0) {
-				if (!atts[i+1])
-					continue;
-				type = atts[i+1];
-				i++;
 			}
 		}
 
 		info->opt = get_option (key);
-		info->opt_type = get_option_type (type);
+		g_string_truncate (info->cdata, 0);
 	}
 
-	info->xml_bound++;
+	g_ptr_array_add (info->stack, cond);
 }
 
 static void
@@ -408,25 +493,59 @@ parse_xml_end_element (void       *data,
 		       const char *name)
 {
 	ParseInfo *info = (ParseInfo *)data;
+	ProfileRule *rule;
+	MatchCond *cond;
+	gboolean value;
+	guint i;
 
-	if (info->xml_bound > info->xml_depth)
-		info->xml_bound = info->xml_depth;
+	g_ptr_array_set_size (info->stack, info->stack->len - 1);
 
-	info->opt = OPT_NONE;
-	info->opt_type = OPT_TYPE_NONE;
+	if (info->opt == OPT_NONE || info->opt == OPT_UNKNOWN)
+		return;
+
+	if (g_ascii_strcasecmp (info->cdata->str, "TRUE") == 0)
+		value = TRUE;
+	else if (g_ascii_strcasecmp (info->cdata->str, "FALSE") == 0)
+		value = FALSE;
+	else
+		goto out;
+
+	rule = g_new0 (ProfileRule, 1);
+	rule->conds = g_ptr_array_new ();
+	rule->opt = info->opt;
+	rule->value = value;
 
-	info->xml_depth--;
+	for (i = 0; i < info->stack->len; i++) {
+		cond = g_ptr_array_index (info->stack, i);
+		if (cond == NULL)
+			continue;
+		if (rule->vendor == NULL && cond->key == MATCH_KEY_SYS_VENDOR)
+			rule->vendor = cond;
+		else
+			g_ptr_array_add (rule->conds, cond);
+	}
+
+	g_ptr_array_add (info->rules, rule);
+out:
+	info->opt = OPT_NONE;
 }
 
+/**
+ * profile_table_compile:
+ *
+ * Compile the rules of one profile into @table. A profile that fails to
+ * parse contributes nothing.
+ **/
 static gboolean
-profile_xml_parse (DmiInfo    *hardware_info,
-		   Options    *options,
-		   const char *filename)
+profile_table_compile (ProfileTable *table,
+		       const char   *filename)
 {
 	ParseInfo *info;
 	XML_Parser parser;
 	char *content;
 	gsize length;
+	gboolean ret = TRUE;
+	guint i;
 	int len;
 
 	if (!g_file_get_contents (filename, &content, &length, NULL)) {
@@ -435,16 +554,11 @@ profile_xml_parse (DmiInfo    *hardware_info,
 	}
 
 	info = g_new0 (ParseInfo, 1);
-	info->hardware_info = hardware_info;
-	info->xml_depth = 0;
-	info->xml_bound = 1;
+	info->stack = g_ptr_array_new ();
+	info->conds = g_ptr_array_new ();
+	info->rules = g_ptr_array_new ();
 	info->opt = OPT_NONE;
-	info->opt_type = OPT_TYPE_NONE;
-	info->options.key_control = options->key_control;
-	info->options.master_key = options->master_key;
-	info->options.force_sync = options->force_sync;
-	info->options.persist = options->persist;
-	info->options.strict_flight_mode = options->strict_flight_mode;
+	info->cdata = g_string_new (NULL);
 
 	parser = XML_ParserCreate (NULL);
 	XML_SetUserData (parser, (void *)info);
@@ -457,29 +571,143 @@ profile_xml_parse (DmiInfo    *hardware_info,
 
 	if (XML_Parse (parser, content, len, 1) == XML_STATUS_ERROR) {
 		g_warning ("Profile Parse error: %s", filename);
-		XML_ParserFree (parser);
-		g_free (info);
-		return FALSE;
+		ret = FALSE;
 	}
 
 	XML_ParserFree (parser);
+	g_free (content);
+
+	if (ret) {
+		for (i = 0; i < info->conds->len; i++)
+			g_ptr_array_add (table->conds,
+					 g_ptr_array_index (info->conds, i));
+		for (i = 0; i < info->rules->len; i++)
+			profile_table_add_rule (table,
+						g_ptr_array_index (info->rules, i));
+	} else {
+		g_ptr_array_foreach (info->rules, (GFunc) profile_rule_free, NULL);
+		g_ptr_array_foreach (info->conds, (GFunc) match_cond_free, NULL);
+	}
 
-	options->key_control = info->options.key_control;
-	options->master_key = info->options.master_key;
-	options->force_sync = info->options.force_sync;
-	options->persist = info->options.persist;
-	options->strict_flight_mode = info->options.strict_flight_mode;
-
+	g_ptr_array_unref (info->stack);
+	g_ptr_array_unref (info->conds);
+	g_ptr_array_unref (info->rules);
+	g_string_free (info->cdata, TRUE);
 	g_free (info);
-	return TRUE;
+
+	return ret;
+}
+
+static void
+set_option (Options  *options,
+	    int       opt,
+	    gboolean  value)
+{
+	switch (opt) {
+	case OPT_KEY_CONTROL:
+		options->key_control = value;
+		break;
+	case OPT_MASTER_KEY:
+		options->master_key = value;
+		break;
+	case OPT_FORCE_SYNC:
+		options->force_sync = value;
+		break;
+	case OPT_PERSIST:
+		options->persist = value;
+		break;
+	case OPT_STRICT_FLIGHT_MODE:
+		options->strict_flight_mode = value;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * profile_table_apply:
+ *
+ * Evaluate @table against @hardware_info. Buckets whose sys_vendor match
+ * fails are skipped as a whole; among the matching rules the last one in
+ * document order wins, as it did when the profiles were applied while
+ * parsing.
+ **/
+static void
+profile_table_apply (ProfileTable *table,
+		     DmiInfo      *hardware_info,
+		     Options      *options)
+{
+	const char *values[NUM_MATCH_KEYS];
+	char *lower[NUM_MATCH_KEYS];
+	guint best_seq[NUM_OPTIONS] = { 0 };
+	gboolean best_value[NUM_OPTIONS] = { FALSE };
+	RuleBucket *bucket;
+	ProfileRule *rule;
+	guint i, j, k;
+	int key;
+
+	values[MATCH_KEY_SYS_VENDOR] = hardware_info->sys_vendor;
+	values[MATCH_KEY_BIOS_DATE] = hardware_info->bios_date;
+	values[MATCH_KEY_BIOS_VENDOR] = hardware_info->bios_vendor;
+	values[MATCH_KEY_BIOS_VERSION] = hardware_info->bios_version;
+	values[MATCH_KEY_PRODUCT_NAME] = hardware_info->product_name;
+	values[MATCH_KEY_PRODUCT_VERSION] = hardware_info->product_version;
+	for (key = 0; key < NUM_MATCH_KEYS; key++)
+		lower[key] = values[key] ? g_ascii_strdown (values[key], -1) : NULL;
+
+	for (i = 0; i < table->conds->len; i++)
+		((MatchCond *) g_ptr_array_index (table->conds, i))->result = MATCH_RESULT_UNKNOWN;
+
+	for (i = 0; i < table->buckets->len; i++) {
+		bucket = g_ptr_array_index (table->buckets, i);
+		if (bucket->vendor &&
+		    !match_cond_eval (bucket->vendor, values, lower))
+			continue;
+
+		for (j = 0; j < bucket->rules->len; j++) {
+			rule = g_ptr_array_index (bucket->rules, j);
+			if (rule->seq < best_seq[rule->opt])
+				continue;
+
+			for (k = 0; k < rule->conds->len; k++) {
+				if (!match_cond_eval (g_ptr_array_index (rule->conds, k),
+						      values, lower))
+					break;
+			}
+			if (k < rule->conds->len)
+				continue;
+
+			best_seq[rule->opt] = rule->seq;
+			best_value[rule->opt] = rule->value;
+		}
+	}
+
+	for (key = 0; key < NUM_OPTIONS; key++) {
+		if (best_seq[key] > 0)
+			set_option (options, key, best_value[key]);
+	}
+
+	for (key = 0; key < NUM_MATCH_KEYS; key++)
+		g_free (lower[key]);
 }
 
+/**
+ * load_configured_settings:
+ *
+ * Load the options resolved on a previous boot. Options we computed
+ * ourselves are only valid for the same hardware and the same set of
+ * profiles, which is what @key encodes. A file without a cache key was
+ * written by hand and is always honoured, as is any file when there is
+ * no @key to compare with.
+ **/
 static gboolean
-load_configured_settings (UrfConfig *config)
+load_configured_settings (UrfConfig  *config,
+			  const char *key)
 {
 	UrfConfigPrivate *priv = config->priv;
 	GKeyFile *profile = g_key_file_new ();
 	gboolean ret = FALSE;
+	char *cached_key;
 	GError *error = NULL;
 
 	ret = g_key_file_load_from_file (profile,
@@ -494,8 +722,18 @@ load_configured_settings (UrfConfig *config)
 
 	if (!g_key_file_has_group (profile, "Profile")) {
 		g_warning ("No valid group in the configured profile");
+		g_key_file_free (profile);
+		return FALSE;
+	}
+
+	cached_key = g_key_file_get_value (profile, "Cache", "key", NULL);
+	if (key != NULL && cached_key != NULL && g_strcmp0 (cached_key, key) != 0) {
+		g_message ("Hardware or profiles changed, reparsing profiles");
+		g_free (cached_key);
+		g_key_file_free (profile);
 		return FALSE;
 	}
+	g_free (cached_key);
 
 	ret = g_key_file_get_boolean (profile, "Profile", "key_control", &error);
 	if (!error)
@@ -538,7 +776,8 @@ load_configured_settings (UrfConfig *config)
 }
 
 static void
-save_configured_profile (UrfConfig *config)
+save_configured_profile (UrfConfig  *config,
+			 const char *key)
 {
 	UrfConfigPrivate *priv = config->priv;
 	GKeyFile *profile;
@@ -581,6 +820,8 @@ save_configured_profile (UrfConfig *config)
 	g_key_file_set_value (profile, "Profile", "strict_flight_mode",
 			      value?"true":"false");
 
+	g_key_file_set_value (profile, "Cache", "key", key);
+
 	content = g_key_file_to_data (profile, NULL, NULL);
 	g_key_file_free (profile);
 
@@ -604,6 +845,98 @@ string_sorter (gconstpointer str1,
 	return g_strcmp0 ((const char*)str1, (const char*)str2);
 }
 
+/**
+ * list_profiles:
+ *
+ * Return the sorted list of profile paths in URFKILL_PROFILE_DIR.
+ **/
+static GList *
+list_profiles (void)
+{
+	GList *profile_list = NULL;
+	GDir *profile_dir = NULL;
+	const char *file;
+	char *full;
+
+	profile_dir = g_dir_open (URFKILL_PROFILE_DIR, 0, NULL);
+	if (profile_dir == NULL)
+		return NULL;
+
+	while ((file = g_dir_read_name (profile_dir))) {
+		if (file[0] == '.' || !g_str_has_suffix (file, ".xml"))
+			continue;
+
+		full = g_build_filename( URFKILL_PROFILE_DIR, file, NULL );
+		if (g_file_test (full, G_FILE_TEST_IS_REGULAR))
+			profile_list = g_list_prepend (profile_list, full);
+		else
+			g_free (full);
+	}
+	g_dir_close (profile_dir);
+
+	return g_list_sort (profile_list, string_sorter);
+}
+
+static void
+checksum_add_string (GChecksum  *checksum,
+		     const char *str)
+{
+	if (str == NULL)
+		str = "";
+	/* Include the terminator so adjacent fields can't run together */
+	g_checksum_update (checksum, (const guchar *)str, strlen (str) + 1);
+}
+
+static void
+checksum_add_mtime (GChecksum  *checksum,
+		    const char *filename)
+{
+	GStatBuf buf;
+	char *stamp;
+
+	if (g_stat (filename, &buf) != 0)
+		stamp = g_strdup_printf ("%s:none", filename);
+	else
+		stamp = g_strdup_printf ("%s:%ld:%ld", filename,
+					 (long) buf.st_mtime,
+					 (long) buf.st_size);
+	checksum_add_string (checksum, stamp);
+	g_free (stamp);
+}
+
+/**
+ * compute_profile_key:
+ *
+ * Hash everything the resolved options depend on: the DMI strings the
+ * match rules look at and the timestamps of the profile files.
+ **/
+static char *
+compute_profile_key (DmiInfo *hardware_info,
+		     GList   *profile_list)
+{
+	GChecksum *checksum;
+	GList *lptr;
+	char *key;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+	checksum_add_string (checksum, hardware_info->sys_vendor);
+	checksum_add_string (checksum, hardware_info->bios_date);
+	checksum_add_string (checksum, hardware_info->bios_vendor);
+	checksum_add_string (checksum, hardware_info->bios_version);
+	checksum_add_string (checksum, hardware_info->product_name);
+	checksum_add_string (checksum, hardware_info->product_version);
+
+	checksum_add_mtime (checksum, URFKILL_PROFILE_DIR);
+	for (lptr = profile_list; lptr; lptr = lptr->next)
+		checksum_add_mtime (checksum, (const char *)lptr->data);
+
+	key = g_strdup (g_checksum_get_string (checksum));
+	g_checksum_free (checksum);
+
+	return key;
+}
+
 /**
  * urf_config_load_profile:
  **/
@@ -613,28 +946,33 @@ urf_config_load_profile (UrfConfig *config)
 	UrfConfigPrivate *priv = config->priv;
 	DmiInfo *hardware_info;
 	Options *options;
+	ProfileTable *table;
 	GList *profile_list = NULL;
 	GList *lptr;
-	GDir *profile_dir = NULL;
-	const char *file;
-	char *profile, *full;
-
-	if (load_configured_settings (config))
-		return;
+	char *key;
 
 	hardware_info = get_dmi_info ();
 	if (hardware_info == NULL) {
 		g_warning ("Failed to get DMI information");
 
+		if (load_configured_settings (config, NULL))
+			return;
+
 		/* If we don't have hardware info, then we can't assume key
 		 * control to be enabled: there would not be a way to disable
 		 * it for devices that don't have it.
 		 */
-		options->key_control = FALSE;
+		priv->options.key_control = FALSE;
 
 		return;
 	}
 
+	profile_list = list_profiles ();
+	key = compute_profile_key (hardware_info, profile_list);
+
+	if (load_configured_settings (config, key))
+		goto out;
+
 	options = g_new0 (Options, 1);
 	options->key_control = priv->options.key_control;
 	options->master_key = priv->options.master_key;
@@ -642,32 +980,13 @@ urf_config_load_profile (UrfConfig *config)
 	options->persist = priv->options.persist;
 	options->strict_flight_mode = priv->options.strict_flight_mode;
 
-	profile_dir = g_dir_open (URFKILL_PROFILE_DIR, 0, NULL);
-	while ((file = g_dir_read_name (profile_dir))) {
-		if (file[0] == '.' || !g_str_has_suffix (file, ".xml"))
-			continue;
-
-		full = g_build_filename( URFKILL_PROFILE_DIR, file, NULL );
-		if (g_file_test (full, G_FILE_TEST_IS_REGULAR))
-			profile_list = g_list_append (profile_list, g_strdup (file));
-		g_free (full);
-	}
-	g_dir_close (profile_dir);
-
-	profile_list = g_list_sort (profile_list, string_sorter);
-
-	for (lptr = profile_list; lptr; lptr = lptr->next) {
-		profile = g_build_filename (URFKILL_PROFILE_DIR,
-					    (const char*)lptr->data,
-					    NULL);
-		profile_xml_parse (hardware_info, options, profile);
-		g_free (profile);
-	}
-
-	/* Clean up the list */
+	table = profile_table_new ();
 	for (lptr = profile_list; lptr; lptr = lptr->next)
-		g_free (lptr->data);
-	g_list_free (profile_list);
+		profile_table_compile (table, (const char *)lptr->data);
+	g_debug ("Compiled %u profile rules into %u vendor buckets",
+		 table->n_rules, table->buckets->len);
+	profile_table_apply (table, hardware_info, options);
+	profile_table_free (table);
 
 	priv->options.key_control = options->key_control;
 	priv->options.master_key = options->master_key;
@@ -675,10 +994,13 @@ urf_config_load_profile (UrfConfig *config)
 	priv->options.persist = options->persist;
 	priv->options.strict_flight_mode = options->strict_flight_mode;
 
-	save_configured_profile (config);
+	save_configured_profile (config, key);
 
-	dmi_info_free (hardware_info);
 	g_free (options);
+out:
+	g_list_free_full (profile_list, g_free);
+	g_free (key);
+	dmi_info_free (hardware_info);
 }
 
 /**
@@ -691,6 +1013,8 @@ urf_config_load_from_file (UrfConfig  *config,
 	UrfConfigPrivate *priv = config->priv;
 	GKeyFile *key_file = g_key_file_new ();
 	gboolean ret = FALSE;
+	gint delay;
+	char *format;
 	GError *error = NULL;
 
 	urf_config_load_profile (config);
@@ -741,6 +1065,17 @@ urf_config_load_from_file (UrfConfig  *config,
 		g_error_free (error);
 	error = NULL;
 
+	delay = g_key_file_get_integer (key_file, "general", "persist_delay", &error);
+	if (!error && delay >= 0)
+		priv->persist_delay = delay;
+	else if (error)
+		g_error_free (error);
+	error = NULL;
+
+	format = g_key_file_get_string (key_file, "general", "persist_format", NULL);
+	urf_config_set_persist_format (config, format);
+	g_free (format);
+
 	g_key_file_free (key_file);
 }
 
@@ -817,6 +1152,13 @@ urf_config_get_persist_state (UrfConfig *config,
 
 	g_return_val_if_fail (end_type >= 0, FALSE);
 
+	if (priv->state_store) {
+		if (!urf_state_store_get (priv->state_store, end_type,
+					  URF_STATE_FIELD_SOFT, &state))
+			g_debug ("No saved state for device %s", type_to_string (end_type));
+		return state;
+	}
+
 	state = g_key_file_get_boolean (priv->persistence_file, type_to_string (end_type), "soft", &error);
 
 	if (error) {
@@ -845,6 +1187,13 @@ urf_config_get_prev_soft (UrfConfig *config,
 	if (type == RFKILL_TYPE_WWAN && urf_config_get_strict_flight_mode (config))
 		return state;
 
+	if (priv->state_store) {
+		if (!urf_state_store_get (priv->state_store, type,
+					  URF_STATE_FIELD_PREV_SOFT, &state))
+			g_debug ("No saved state for device %s", type_to_string (type));
+		return state;
+	}
+
 	state = g_key_file_get_boolean (priv->persistence_file, type_to_string (type), "prev-soft", &error);
 
 	if (error) {
@@ -869,21 +1218,88 @@ urf_config_save_persistence_file (UrfConfig *config)
 
 	content = g_key_file_to_data (priv->persistence_file, NULL, NULL);
 
-	if (content) {
-		ret = g_file_set_contents (URFKILL_PERSISTENCE_FILENAME,
-					   content, -1, &error);
-		if (!ret) {
-			if (error) {
-				g_warning ("Failed to write persistence data: %s", error->message);
-				g_error_free (error);
-			}
-		} else {
-			g_chmod (URFKILL_PERSISTENCE_FILENAME,
-				 S_IRUSR | S_IRGRP | S_IROTH);
-		}
+	if (content == NULL)
+		return;
 
+	/* nothing changed since the last write */
+	if (g_strcmp0 (content, priv->persistence_data) == 0) {
 		g_free (content);
+		return;
 	}
+
+	ret = g_file_set_contents (URFKILL_PERSISTENCE_FILENAME,
+				   content, -1, &error);
+	if (!ret) {
+		if (error) {
+			g_warning ("Failed to write persistence data: %s", error->message);
+			g_error_free (error);
+		}
+		g_free (content);
+		return;
+	}
+
+	g_chmod (URFKILL_PERSISTENCE_FILENAME,
+		 S_IRUSR | S_IRGRP | S_IROTH);
+
+	g_free (priv->persistence_data);
+	priv->persistence_data = content;
+}
+
+/**
+ * urf_config_save_timeout_cb:
+ **/
+static gboolean
+urf_config_save_timeout_cb (gpointer user_data)
+{
+	UrfConfig *config = URF_CONFIG (user_data);
+
+	config->priv->persist_save_id = 0;
+	urf_config_save_persistence_file (config);
+
+	return FALSE;
+}
+
+/**
+ * urf_config_schedule_save:
+ *
+ * Changes made within persist_delay milliseconds are written out
+ * together.
+ **/
+static void
+urf_config_schedule_save (UrfConfig *config)
+{
+	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+
+	if (priv->persist_delay == 0) {
+		urf_config_save_persistence_file (config);
+		return;
+	}
+
+	if (priv->persist_save_id == 0)
+		priv->persist_save_id = g_timeout_add (priv->persist_delay,
+						       urf_config_save_timeout_cb,
+						       config);
+}
+
+/**
+ * urf_config_flush:
+ *
+ * Writes out pending changes of the persistence file now.
+ **/
+void
+urf_config_flush (UrfConfig *config)
+{
+	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+
+	if (priv->persist_save_id > 0) {
+		g_source_remove (priv->persist_save_id);
+		priv->persist_save_id = 0;
+	}
+
+	if (priv->state_store)
+		urf_state_store_sync (priv->state_store);
+	else if (priv->persistence_file)
+		urf_config_save_persistence_file (config);
 }
 
 /**
@@ -904,9 +1320,14 @@ urf_config_set_persist_state (UrfConfig *config,
 
 	g_debug ("setting state for device %s: %s", type_to_string (type), state > 0 ? "blocked" : "unblocked");
 
+	if (priv->state_store) {
+		urf_state_store_set (priv->state_store, type, URF_STATE_FIELD_SOFT, state > 0);
+		return;
+	}
+
 	g_key_file_set_boolean (priv->persistence_file, type_to_string (type), "soft", state > 0);
 
-	urf_config_save_persistence_file (config);
+	urf_config_schedule_save (config);
 }
 
 void
@@ -923,8 +1344,13 @@ urf_config_set_prev_soft (UrfConfig *config,
 
 	g_debug ("setting state for device %s: %s", type_to_string (type), block ? "blocked" : "unblocked");
 
+	if (priv->state_store) {
+		urf_state_store_set (priv->state_store, type, URF_STATE_FIELD_PREV_SOFT, block);
+		return;
+	}
+
 	g_key_file_set_boolean (priv->persistence_file, type_to_string (type), "prev-soft", block);
-	urf_config_save_persistence_file (config);
+	urf_config_schedule_save (config);
 }
 
 static void
@@ -942,7 +1368,57 @@ urf_config_get_persistence_file (UrfConfig *config)
 	if (error) {
 		g_warning ("Persistence file could not be loaded: %s", error->message);
 		g_error_free (error);
+		return;
+	}
+
+	priv->persistence_data = g_key_file_to_data (priv->persistence_file, NULL, NULL);
+}
+
+/**
+ * urf_config_set_persist_format:
+ *
+ * Selects where the persisted states live: the saved-states key file
+ * ("keyfile", the default) or the binary state store ("binary"). The
+ * states are migrated when the format changed since the last run.
+ **/
+static void
+urf_config_set_persist_format (UrfConfig  *config,
+			       const char *format)
+{
+	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	UrfStateStore *store;
+	gboolean migrate;
+
+	if (g_strcmp0 (format, "binary") == 0) {
+		if (priv->state_store)
+			return;
+
+		migrate = !urf_state_store_exists (URFKILL_STATE_STORE_FILENAME);
+		priv->state_store = urf_state_store_open (URFKILL_STATE_STORE_FILENAME);
+
+		if (migrate) {
+			g_message ("Migrating persisted states to %s",
+				   URFKILL_STATE_STORE_FILENAME);
+			urf_state_store_import_keyfile (priv->state_store,
+							priv->persistence_file);
+		}
+		return;
 	}
+
+	if (format != NULL && g_strcmp0 (format, "keyfile") != 0)
+		g_warning ("Unknown persist_format '%s', using keyfile", format);
+
+	if (!urf_state_store_exists (URFKILL_STATE_STORE_FILENAME))
+		return;
+
+	g_message ("Migrating persisted states to %s", URFKILL_PERSISTENCE_FILENAME);
+
+	store = urf_state_store_open (URFKILL_STATE_STORE_FILENAME);
+	urf_state_store_export_keyfile (store, priv->persistence_file);
+	urf_state_store_free (store);
+
+	urf_config_save_persistence_file (config);
+	urf_state_store_remove (URFKILL_STATE_STORE_FILENAME);
 }
 
 /**
@@ -958,6 +1434,7 @@ urf_config_init (UrfConfig *config)
 	priv->options.force_sync = FALSE;
 	priv->options.persist = TRUE;
 	priv->options.strict_flight_mode = TRUE;
+	priv->persist_delay = URFKILL_PERSIST_DELAY_DEFAULT;
 	config->priv = priv;
 
 	urf_config_get_persistence_file (config);
@@ -981,11 +1458,17 @@ urf_config_finalize (GObject *object)
 	UrfConfigPrivate *priv = URF_CONFIG(object)->priv;
 
 	if (priv->persistence_file) {
-		urf_config_save_persistence_file (URF_CONFIG (object));
+		urf_config_flush (URF_CONFIG (object));
 		g_key_file_free (priv->persistence_file);
 		priv->persistence_file = NULL;
 	}
 
+	if (priv->state_store) {
+		urf_state_store_free (priv->state_store);
+		priv->state_store = NULL;
+	}
+
+	g_free (priv->persistence_data);
 	g_free (priv->user);
 
 	G_OBJECT_CLASS(urf_config_parent_class)->finalize(object);
@@ -75,6 +75,7 @@ gboolean	 urf_config_get_prev_soft	(UrfConfig*config,
 void		 urf_config_set_prev_soft	(UrfConfig*config,
 						 const gint type,
 						 gboolean block);
+void		 urf_config_flush		(UrfConfig	*config);
 
 G_END_DECLS
 
@@ -38,6 +38,7 @@
 #include "urf-utils.h"
 #include "urf-config.h"
 #include "urf-ofono-manager.h"
+#include "urf-signal-scheduler.h"
 
 #if defined SESSION_TRACKING_CK
 #include "urf-session-checker-consolekit.h"
@@ -49,6 +50,7 @@
 
 #define URFKILL_DBUS_INTERFACE "org.freedesktop.URfkill"
 #define URFKILL_OBJECT_PATH "/org/freedesktop/URfkill"
+#define OBJECT_MANAGER_INTERFACE "org.freedesktop.DBus.ObjectManager"
 
 static const char introspection_xml[] =
 "<node>"
@@ -66,6 +68,10 @@ static const char introspection_xml[] =
 "    <method name='EnumerateDevices'>"
 "      <arg type='ao' name='array' direction='out'/>"
 "    </method>"
+"    <method name='GetAllStates'>"
+"      <arg type='a(ii)' name='killswitches' direction='out'/>"
+"      <arg type='a(iisbbb)' name='devices' direction='out'/>"
+"    </method>"
 "    <method name='IsFlightMode'>"
 "      <arg type='b' name='is_flight_mode' direction='out'/>"
 "    </method>"
@@ -101,6 +107,19 @@ static const char introspection_xml[] =
 "    <property name='DaemonVersion' type='s' access='read'/>"
 "    <property name='KeyControl' type='b' access='read'/>"
 "  </interface>"
+"  <interface name='org.freedesktop.DBus.ObjectManager'>"
+"    <method name='GetManagedObjects'>"
+"      <arg type='a{oa{sa{sv}}}' name='objects' direction='out'/>"
+"    </method>"
+"    <signal name='InterfacesAdded'>"
+"      <arg type='o' name='object_path'/>"
+"      <arg type='a{sa{sv}}' name='interfaces_and_properties'/>"
+"    </signal>"
+"    <signal name='InterfacesRemoved'>"
+"      <arg type='o' name='object_path'/>"
+"      <arg type='as' name='interfaces'/>"
+"    </signal>"
+"  </interface>"
 "</node>";
 
 static const GDBusErrorEntry urf_daemon_error_entries[] =
@@ -131,6 +150,23 @@ enum
 
 static guint signals[SIGNAL_LAST] = { 0 };
 
+typedef enum {
+	URF_DAEMON_JOB_BLOCK,
+	URF_DAEMON_JOB_BLOCK_IDX,
+	URF_DAEMON_JOB_FLIGHT_MODE,
+} UrfDaemonJobKind;
+
+/* An authorized Block, BlockIdx or FlightMode request. The lane is the
+ * rfkill type it touches, or RFKILL_TYPE_ALL for the ones touching
+ * every type. */
+typedef struct {
+	UrfDaemonJobKind	 kind;
+	gint			 target;	/* type or index */
+	gint			 lane;
+	gboolean		 block;
+	GList			*invocations;	/* coalesced callers */
+} UrfDaemonJob;
+
 struct UrfDaemonPrivate
 {
 	UrfConfig		*config;
@@ -141,11 +177,13 @@ struct UrfDaemonPrivate
 	UrfOfonoManager		*ofono_manager;
 	gboolean		 key_control;
 	gboolean		 flight_mode;
-	gboolean		 pending_block;
 	gboolean		 master_key;
 	GDBusConnection		*connection;
 	GDBusNodeInfo		*introspection_data;
-	GDBusMethodInvocation   *invocation;
+	GQueue			*pending_jobs;
+	UrfDaemonJob		*running_jobs[NUM_RFKILL_TYPES]; /* by lane */
+	GHashTable		*changed_devices;
+	GHashTable		*managed_interfaces; /* device path -> GStrv */
 };
 
 static void urf_daemon_dispose (GObject *object);
@@ -155,6 +193,65 @@ G_DEFINE_TYPE (UrfDaemon, urf_daemon, G_TYPE_OBJECT)
 #define URF_DAEMON_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
 				URF_TYPE_DAEMON, UrfDaemonPrivate))
 
+/* A privileged call waiting for its polkit authorization */
+typedef struct {
+	UrfDaemon		*daemon;
+	GDBusMethodInvocation	*invocation;
+	gint			 target;	/* type or index */
+	gboolean		 block;
+} UrfDaemonRequest;
+
+/**
+ * urf_daemon_request_new:
+ **/
+static UrfDaemonRequest *
+urf_daemon_request_new (UrfDaemon             *daemon,
+			GDBusMethodInvocation *invocation,
+			gint                   target,
+			gboolean               block)
+{
+	UrfDaemonRequest *request;
+
+	request = g_slice_new (UrfDaemonRequest);
+	request->daemon = g_object_ref (daemon);
+	request->invocation = invocation;
+	request->target = target;
+	request->block = block;
+
+	return request;
+}
+
+/**
+ * urf_daemon_request_free:
+ **/
+static void
+urf_daemon_request_free (UrfDaemonRequest *request)
+{
+	g_object_unref (request->daemon);
+	g_slice_free (UrfDaemonRequest, request);
+}
+
+/**
+ * urf_daemon_request_authorized:
+ *
+ * Finish the polkit check of a request. On failure the error has
+ * already been returned to the caller.
+ **/
+static gboolean
+urf_daemon_request_authorized (UrfDaemonRequest *request,
+			       GAsyncResult     *res)
+{
+	GError *error = NULL;
+
+	if (!urf_polkit_check_auth_finish (request->daemon->priv->polkit, res, &error)) {
+		g_dbus_method_invocation_return_gerror (request->invocation, error);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 /**
  * urf_daemon_input_event_cb:
  **/
@@ -227,6 +324,87 @@ out:
 	}
 }
 
+/**
+ * urf_daemon_job_new:
+ **/
+static UrfDaemonJob *
+urf_daemon_job_new (UrfDaemonJobKind       kind,
+		    gint                   target,
+		    gint                   lane,
+		    gboolean               block,
+		    GDBusMethodInvocation *invocation)
+{
+	UrfDaemonJob *job;
+
+	job = g_slice_new0 (UrfDaemonJob);
+	job->kind = kind;
+	job->target = target;
+	job->lane = lane;
+	job->block = block;
+	job->invocations = g_list_append (NULL, invocation);
+
+	return job;
+}
+
+/**
+ * urf_daemon_job_return:
+ *
+ * Answer every caller that was coalesced into @job.
+ **/
+static void
+urf_daemon_job_return (UrfDaemonJob *job,
+		       const GError *error)
+{
+	GList *item;
+
+	for (item = job->invocations; item; item = item->next) {
+		GDBusMethodInvocation *invocation = item->data;
+
+		if (error == NULL)
+			g_dbus_method_invocation_return_value (invocation,
+							       g_variant_new ("(b)", TRUE));
+		else
+			g_dbus_method_invocation_return_gerror (invocation, error);
+	}
+
+	g_list_free (job->invocations);
+	job->invocations = NULL;
+}
+
+/**
+ * urf_daemon_job_free:
+ **/
+static void
+urf_daemon_job_free (UrfDaemonJob *job)
+{
+	g_list_free (job->invocations);
+	g_slice_free (UrfDaemonJob, job);
+}
+
+static void urf_daemon_schedule (UrfDaemon *daemon);
+
+/**
+ * urf_daemon_job_finish:
+ *
+ * Complete the running @job, free its lane and start whatever was
+ * waiting for it.
+ **/
+static void
+urf_daemon_job_finish (UrfDaemon    *daemon,
+		       UrfDaemonJob *job,
+		       const GError *error)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+
+	urf_daemon_job_return (job, error);
+
+	g_assert (priv->running_jobs[job->lane] == job);
+	priv->running_jobs[job->lane] = NULL;
+	urf_daemon_job_free (job);
+
+	urf_daemon_schedule (daemon);
+}
+
 /**
  * block_cb:
  **/
@@ -237,8 +415,8 @@ block_cb (GObject *source,
 {
 	UrfDaemon        *daemon;
 	UrfDaemonPrivate *priv;
+	UrfDaemonJob     *job = user_data;
 	GError           *error = NULL;
-	gint              type;
 
 	g_assert (URF_IS_DAEMON (source));
 	daemon = URF_DAEMON(source);
@@ -249,116 +427,47 @@ block_cb (GObject *source,
 
 	priv = daemon->priv;
 
-	type = GPOINTER_TO_INT (g_task_get_task_data (G_TASK (res)));
-
 	g_task_propagate_pointer(G_TASK (res), &error);
 	g_object_unref (G_TASK (res));
 
 	if (error == NULL) {
 		g_debug ("%s: success", __func__);
 
-		g_dbus_method_invocation_return_value (priv->invocation,
-						       g_variant_new ("(b)", TRUE));
-
-		urf_config_set_persist_state (priv->config, type, priv->pending_block);
+		urf_config_set_persist_state (priv->config, job->target, job->block);
 	} else {
 		g_warning ("%s: failed to set type %s to block %s", __func__,
-			   type_to_string (type),
-			   priv->pending_block ? "blocked" : "unblocked");
-
-		g_dbus_method_invocation_return_error (priv->invocation,
-						       error->domain,
-		                                       error->code,
-						       "%s", error->message);
-		g_error_free (error);
-		error = NULL;
+			   type_to_string (job->target),
+			   job->block ? "blocked" : "unblocked");
 	}
 
-	priv->invocation = NULL;
+	urf_daemon_job_finish (daemon, job, error);
+	if (error != NULL)
+		g_error_free (error);
 }
 
 /**
- * urf_daemon_block:
+ * urf_daemon_block_start:
  **/
-void
-urf_daemon_block (UrfDaemon             *daemon,
-		  const gint             type,
-		  const gboolean         block,
-		  GDBusMethodInvocation *invocation)
+static void
+urf_daemon_block_start (UrfDaemon    *daemon,
+			UrfDaemonJob *job)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	PolkitSubject *subject = NULL;
 	KillswitchState state;
 	GTask *task;
-	gint error = 0;
-	char *error_str;
-	gboolean done = FALSE;
-
-	g_return_val_if_fail (type >= 0, FALSE);
-
-	if (!urf_arbitrator_has_devices (priv->arbitrator))
-		goto out;
-
-	subject = urf_polkit_get_subject (priv->polkit, invocation);
-	if (subject == NULL)
-		goto out;
-
-	if (!urf_polkit_check_auth (priv->polkit, subject, "org.freedesktop.urfkill.block", invocation))
-		goto out;
-
-	if (type < 0 || type >= NUM_RFKILL_TYPES) {
-		g_warning ("%s: invalid type specified %d", __func__, type);
 
-		error = URF_DAEMON_ERROR_INVALID;
-		error_str = g_strdup_printf ("invalid type: %d", type);
+	state = urf_arbitrator_get_state (priv->arbitrator, job->target);
 
-		goto out;
-	}
-
-	if (priv->invocation != NULL) {
-		g_debug ("%s: operation already inprogress...", __func__);
-
-		error = URF_DAEMON_ERROR_IN_PROGRESS;
-		error_str = g_strdup ("operation already in progress");
-
-		goto out;
-	}
-
-	state = urf_arbitrator_get_state (priv->arbitrator, type);
-
-	if ((block && state == KILLSWITCH_STATE_SOFT_BLOCKED) ||
-	    (!block && state == KILLSWITCH_STATE_UNBLOCKED)) {
+	if ((job->block && state == KILLSWITCH_STATE_SOFT_BLOCKED) ||
+	    (!job->block && state == KILLSWITCH_STATE_UNBLOCKED)) {
 		g_debug ("%s: block == current state", __func__);
-
-		done = TRUE;
-
-		goto out;
+		urf_daemon_job_finish (daemon, job, NULL);
+		return;
 	}
 
-	priv->pending_block = block;
-	priv->invocation = invocation;
-
-	task = g_task_new (daemon, NULL, block_cb, NULL);
-	g_task_set_task_data (task, GINT_TO_POINTER (type), NULL);
+	task = g_task_new (daemon, NULL, block_cb, job);
 
-	urf_arbitrator_set_block (priv->arbitrator, type, block, task);
-
-out:
-	if (subject != NULL)
-		g_object_unref (subject);
-
-	if (error) {
-		g_dbus_method_invocation_return_error (invocation,
-						       URF_DAEMON_ERROR,
-						       error,
-						       "%s", error_str);
-		g_free (error_str);
-
-	} else if (done) {
-
-		g_dbus_method_invocation_return_value (invocation,
-						       g_variant_new ("(b)", TRUE));
-	}
+	urf_arbitrator_set_block (priv->arbitrator, job->target, job->block, task);
 }
 
 /**
@@ -371,10 +480,8 @@ block_idx_cb (GObject *source,
 {
 	UrfDaemon        *daemon;
 	UrfDaemonPrivate *priv;
-	UrfDevice        *device;
+	UrfDaemonJob     *job = user_data;
 	GError           *error = NULL;
-	gint              index;
-	gint              type;
 
 	g_assert (URF_IS_DAEMON (source));
 	daemon = URF_DAEMON(source);
@@ -385,122 +492,388 @@ block_idx_cb (GObject *source,
 
 	priv = daemon->priv;
 
-	index = GPOINTER_TO_INT (g_task_get_task_data (G_TASK (res)));
-	device = urf_arbitrator_get_device (priv->arbitrator, index);
-
-	g_assert (device);
-
 	g_task_propagate_pointer(G_TASK (res), &error);
 	g_object_unref (G_TASK (res));
 
-	type = urf_device_get_device_type (device);
-
 	if (error == NULL) {
 		g_debug ("%s: success", __func__);
 
-		g_dbus_method_invocation_return_value (priv->invocation,
-						       g_variant_new ("(b)", TRUE));
-
-		urf_config_set_persist_state (priv->config, type, priv->pending_block);
+		urf_config_set_persist_state (priv->config, job->lane, job->block);
 	} else {
 		g_warning ("%s: failed device %u (%s) to %s",
 			   __func__,
-                           index,
-                           type_to_string (type),
-                           priv->pending_block ? "blocked" : "unblocked");
-
-		g_dbus_method_invocation_return_error (priv->invocation,
-						       error->domain,
-		                                       error->code,
-						       "%s", error->message);
-		g_error_free (error);
-		error = NULL;
+                           job->target,
+                           type_to_string (job->lane),
+                           job->block ? "blocked" : "unblocked");
 	}
 
-	priv->invocation = NULL;
+	urf_daemon_job_finish (daemon, job, error);
+	if (error != NULL)
+		g_error_free (error);
 }
 
 /**
- * urf_daemon_block_idx:
+ * urf_daemon_block_idx_start:
  **/
-void
-urf_daemon_block_idx (UrfDaemon             *daemon,
-		      const gint             index,
-		      const gboolean         block,
-		      GDBusMethodInvocation *invocation)
+static void
+urf_daemon_block_idx_start (UrfDaemon    *daemon,
+			    UrfDaemonJob *job)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	PolkitSubject *subject = NULL;
 	KillswitchState state;
 	GTask *task;
-	gint error = 0;
-	char *error_str;
-	gboolean done = FALSE;
+	GError *error;
+
+	/* The device may have gone while the job was queued */
+	if (urf_arbitrator_get_device (priv->arbitrator, job->target) == NULL) {
+		error = g_error_new (URF_DAEMON_ERROR,
+				     URF_DAEMON_ERROR_INVALID,
+				     "invalid index: %d", job->target);
+		urf_daemon_job_finish (daemon, job, error);
+		g_error_free (error);
+		return;
+	}
 
-	if (!urf_arbitrator_has_devices (priv->arbitrator))
-		goto out;
+	state = urf_arbitrator_get_state_idx (priv->arbitrator, job->target);
 
-	subject = urf_polkit_get_subject (priv->polkit, invocation);
-	if (subject == NULL)
-		goto out;
+	if ((job->block && state == KILLSWITCH_STATE_SOFT_BLOCKED) ||
+	    (!job->block && state == KILLSWITCH_STATE_UNBLOCKED)) {
+		g_debug ("%s: block == current state", __func__);
+		urf_daemon_job_finish (daemon, job, NULL);
+		return;
+	}
 
-	if (!urf_polkit_check_auth (priv->polkit, subject, "org.freedesktop.urfkill.blockidx", invocation))
-		goto out;
+	task = g_task_new (daemon, NULL, block_idx_cb, job);
 
-	if (index < 0 || !urf_arbitrator_get_device (priv->arbitrator, index)) {
-		g_warning ("%s: invalid index specified %d", __func__, index);
+	urf_arbitrator_set_block_idx (priv->arbitrator, job->target, job->block, task);
+}
+
+/**
+ * flight_mode_cb:
+ **/
+static void
+flight_mode_cb (GObject *source,
+		GAsyncResult *res,
+		gpointer user_data)
+{
+	UrfDaemon        *daemon;
+	UrfDaemonPrivate *priv;
+	UrfDaemonJob     *job = user_data;
+	GError            *error = NULL;
 
-		error = URF_DAEMON_ERROR_INVALID;
-		error_str = g_strdup_printf ("invalid index: %d", index);
+	g_assert (URF_IS_DAEMON (source));
+	daemon = URF_DAEMON(source);
 
-		goto out;
+	g_assert (g_task_is_valid (res, source));
+
+	priv = daemon->priv;
+
+	g_task_propagate_pointer (G_TASK (res), &error);
+	g_object_unref (G_TASK (res));
+
+	if (error == NULL) {
+		GError *emit_error = NULL;
+
+		g_debug ("%s: success", __func__);
+
+		priv->flight_mode = job->block;
+		urf_config_set_persist_state (priv->config, RFKILL_TYPE_ALL,
+		                              job->block
+		                              ? KILLSWITCH_STATE_SOFT_BLOCKED
+		                              : KILLSWITCH_STATE_UNBLOCKED);
+
+		g_signal_emit (daemon, signals[SIGNAL_FLIGHT_MODE_CHANGED], 0, priv->flight_mode);
+		g_dbus_connection_emit_signal (priv->connection,
+		                               NULL,
+		                               URFKILL_OBJECT_PATH,
+		                               URFKILL_DBUS_INTERFACE,
+		                               "FlightModeChanged",
+		                               g_variant_new ("(b)", priv->flight_mode),
+		                               &emit_error);
+		if (emit_error) {
+			g_warning ("Failed to emit FlightModeChanged: %s", emit_error->message);
+			g_error_free (emit_error);
+		}
+	} else {
+		g_warning ("%s: failed to set device flight mode to %s", __func__,
+			   job->block ? "blocked" : "unblocked");
 	}
 
-	if (priv->invocation != NULL) {
-		g_debug ("%s: operation already inprogress...", __func__);
+	urf_daemon_job_finish (daemon, job, error);
+	if (error != NULL)
+		g_error_free (error);
+}
 
-		error = URF_DAEMON_ERROR_IN_PROGRESS;
-		error_str = g_strdup ("operation already in progress");
+/**
+ * urf_daemon_flight_mode_start:
+ **/
+static void
+urf_daemon_flight_mode_start (UrfDaemon    *daemon,
+			      UrfDaemonJob *job)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	GTask *task;
 
-		goto out;
+	if (priv->flight_mode == job->block) {
+		g_debug ("%s: flight_mode == block", __func__);
+		urf_daemon_job_finish (daemon, job, NULL);
+		return;
 	}
 
-	state = urf_arbitrator_get_state_idx (priv->arbitrator, index);
+	task = g_task_new (daemon, NULL, flight_mode_cb, job);
 
-	if ((block && state == KILLSWITCH_STATE_SOFT_BLOCKED) ||
-	    (!block && state == KILLSWITCH_STATE_UNBLOCKED)) {
-		g_debug ("%s: block == current state", __func__);
+	urf_arbitrator_flight_mode (priv->arbitrator, job->block, task);
+}
+
+/**
+ * urf_daemon_next_job:
+ *
+ * Find the first queued job that may start now. Jobs of different
+ * types run in parallel, jobs of one type run in order, and a job on
+ * the RFKILL_TYPE_ALL lane runs alone: it waits for every running job
+ * and holds back everything queued after it.
+ **/
+static GList *
+urf_daemon_next_job (UrfDaemon *daemon)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	gboolean seen[NUM_RFKILL_TYPES] = { FALSE };
+	gboolean busy = FALSE;
+	GList *link;
+	gint i;
 
-		done = TRUE;
+	if (priv->running_jobs[RFKILL_TYPE_ALL] != NULL)
+		return NULL;
 
-		goto out;
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++)
+		busy |= (priv->running_jobs[i] != NULL);
+
+	for (link = priv->pending_jobs->head; link; link = link->next) {
+		UrfDaemonJob *job = link->data;
+
+		if (job->lane == RFKILL_TYPE_ALL)
+			return busy ? NULL : link;
+
+		if (!seen[job->lane] && priv->running_jobs[job->lane] == NULL)
+			return link;
+
+		seen[job->lane] = TRUE;
+		busy = TRUE;
 	}
 
-	priv->pending_block = block;
-	priv->invocation = invocation;
+	return NULL;
+}
 
-	task = g_task_new (daemon, NULL, block_idx_cb, NULL);
-	g_task_set_task_data (task, GINT_TO_POINTER (index), NULL);
+/**
+ * urf_daemon_schedule:
+ **/
+static void
+urf_daemon_schedule (UrfDaemon *daemon)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	UrfDaemonJob *job;
+	GList *link;
+
+	while ((link = urf_daemon_next_job (daemon)) != NULL) {
+		job = link->data;
+		g_queue_delete_link (priv->pending_jobs, link);
+
+		g_debug ("%s: starting job on %s lane (%u callers)", __func__,
+			 type_to_string (job->lane),
+			 g_list_length (job->invocations));
+
+		/* A job may finish right away and reschedule; the scan
+		 * starts over from the head every time */
+		priv->running_jobs[job->lane] = job;
+		switch (job->kind) {
+		case URF_DAEMON_JOB_BLOCK:
+			urf_daemon_block_start (daemon, job);
+			break;
+		case URF_DAEMON_JOB_BLOCK_IDX:
+			urf_daemon_block_idx_start (daemon, job);
+			break;
+		case URF_DAEMON_JOB_FLIGHT_MODE:
+			urf_daemon_flight_mode_start (daemon, job);
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+	}
+}
 
-	urf_arbitrator_set_block_idx (priv->arbitrator, index, block, task);
+/**
+ * urf_daemon_enqueue:
+ *
+ * Queue a request. If the last queued job it would run after has the
+ * same target, the request is folded into it: the newest block value
+ * wins and every caller gets the result of the one operation.
+ **/
+static void
+urf_daemon_enqueue (UrfDaemon             *daemon,
+		    UrfDaemonJobKind       kind,
+		    gint                   target,
+		    gint                   lane,
+		    gboolean               block,
+		    GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	GList *link;
+
+	for (link = priv->pending_jobs->tail; link; link = link->prev) {
+		UrfDaemonJob *job = link->data;
+
+		if (job->lane != lane &&
+		    job->lane != RFKILL_TYPE_ALL &&
+		    lane != RFKILL_TYPE_ALL)
+			continue;
+
+		if (job->kind == kind && job->target == target) {
+			g_debug ("%s: coalescing request for %s", __func__,
+				 type_to_string (lane));
+			job->block = block;
+			job->invocations = g_list_append (job->invocations, invocation);
+			return;
+		}
+		break;
+	}
 
-out:
-	if (subject != NULL)
-		g_object_unref (subject);
+	g_queue_push_tail (priv->pending_jobs,
+			   urf_daemon_job_new (kind, target, lane, block, invocation));
+	urf_daemon_schedule (daemon);
+}
 
-	if (error) {
+/**
+ * urf_daemon_block_authorized:
+ **/
+static void
+urf_daemon_block_authorized (UrfDaemon             *daemon,
+			     const gint             type,
+			     const gboolean         block,
+			     GDBusMethodInvocation *invocation)
+{
+	if (type < 0 || type >= NUM_RFKILL_TYPES) {
+		g_warning ("%s: invalid type specified %d", __func__, type);
 		g_dbus_method_invocation_return_error (invocation,
 						       URF_DAEMON_ERROR,
-						       error,
-						       "%s", error_str);
-		g_free (error_str);
+						       URF_DAEMON_ERROR_INVALID,
+						       "invalid type: %d", type);
+		return;
+	}
 
-	} else if (done) {
+	urf_daemon_enqueue (daemon, URF_DAEMON_JOB_BLOCK, type, type, block, invocation);
+}
+
+/**
+ * urf_daemon_block_auth_cb:
+ **/
+static void
+urf_daemon_block_auth_cb (GObject      *source,
+			  GAsyncResult *res,
+			  gpointer      user_data)
+{
+	UrfDaemonRequest *request = user_data;
+
+	if (urf_daemon_request_authorized (request, res))
+		urf_daemon_block_authorized (request->daemon,
+					     request->target,
+					     request->block,
+					     request->invocation);
+	urf_daemon_request_free (request);
+}
+
+/**
+ * urf_daemon_block:
+ **/
+void
+urf_daemon_block (UrfDaemon             *daemon,
+		  const gint             type,
+		  const gboolean         block,
+		  GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
 
+	/* Nothing to block, but the caller still waits for a reply */
+	if (!urf_arbitrator_has_devices (priv->arbitrator)) {
 		g_dbus_method_invocation_return_value (invocation,
 						       g_variant_new ("(b)", TRUE));
+		return;
+	}
+
+	urf_polkit_check_auth_async (priv->polkit, invocation,
+				     "org.freedesktop.urfkill.block", NULL,
+				     urf_daemon_block_auth_cb,
+				     urf_daemon_request_new (daemon, invocation, type, block));
+}
+
+/**
+ * urf_daemon_block_idx_authorized:
+ **/
+static void
+urf_daemon_block_idx_authorized (UrfDaemon             *daemon,
+				 const gint             index,
+				 const gboolean         block,
+				 GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	UrfDevice *device = NULL;
+
+	if (index >= 0)
+		device = urf_arbitrator_get_device (priv->arbitrator, index);
+
+	if (device == NULL) {
+		g_warning ("%s: invalid index specified %d", __func__, index);
+		g_dbus_method_invocation_return_error (invocation,
+						       URF_DAEMON_ERROR,
+						       URF_DAEMON_ERROR_INVALID,
+						       "invalid index: %d", index);
+		return;
+	}
+
+	urf_daemon_enqueue (daemon, URF_DAEMON_JOB_BLOCK_IDX, index,
+			    urf_device_get_device_type (device), block, invocation);
+}
+
+/**
+ * urf_daemon_block_idx_auth_cb:
+ **/
+static void
+urf_daemon_block_idx_auth_cb (GObject      *source,
+			      GAsyncResult *res,
+			      gpointer      user_data)
+{
+	UrfDaemonRequest *request = user_data;
+
+	if (urf_daemon_request_authorized (request, res))
+		urf_daemon_block_idx_authorized (request->daemon,
+						 request->target,
+						 request->block,
+						 request->invocation);
+	urf_daemon_request_free (request);
+}
+
+/**
+ * urf_daemon_block_idx:
+ **/
+void
+urf_daemon_block_idx (UrfDaemon             *daemon,
+		      const gint             index,
+		      const gboolean         block,
+		      GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+
+	if (!urf_arbitrator_has_devices (priv->arbitrator)) {
+		g_dbus_method_invocation_return_error (invocation,
+						       URF_DAEMON_ERROR,
+						       URF_DAEMON_ERROR_INVALID,
+						       "invalid index: %d", index);
+		return;
 	}
 
+	urf_polkit_check_auth_async (priv->polkit, invocation,
+				     "org.freedesktop.urfkill.blockidx", NULL,
+				     urf_daemon_block_idx_auth_cb,
+				     urf_daemon_request_new (daemon, invocation, index, block));
 }
 
 /**
@@ -537,81 +910,140 @@ urf_daemon_enumerate_devices (UrfDaemon             *daemon,
 }
 
 /**
- * urf_daemon_is_flight_mode:
+ * urf_daemon_get_all_states:
+ *
+ * Snapshot of the state of every killswitch and the block states of
+ * every device, straight from the arbitrator.
  **/
 gboolean
-urf_daemon_is_flight_mode (UrfDaemon             *daemon,
+urf_daemon_get_all_states (UrfDaemon             *daemon,
 			   GDBusMethodInvocation *invocation)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	GVariant *value;
+	UrfKillswitch *killswitch;
+	UrfDevice *device;
+	GVariantBuilder killswitches;
+	GVariantBuilder devices;
+	const char *name;
+	GList *item;
+	gint type;
 
-	value = g_variant_new ("(b)", priv->flight_mode);
-	g_dbus_method_invocation_return_value (invocation, value);
+	g_return_val_if_fail (URF_IS_DAEMON (daemon), FALSE);
+
+	g_variant_builder_init (&killswitches, G_VARIANT_TYPE ("a(ii)"));
+	for (type = RFKILL_TYPE_ALL + 1; type < NUM_RFKILL_TYPES; type++) {
+		killswitch = urf_arbitrator_get_killswitch (priv->arbitrator, type);
+		if (killswitch == NULL)
+			continue;
+		g_variant_builder_add (&killswitches, "(ii)", type,
+				       urf_killswitch_get_state (killswitch));
+	}
+
+	g_variant_builder_init (&devices, G_VARIANT_TYPE ("a(iisbbb)"));
+	for (item = urf_arbitrator_get_devices (priv->arbitrator); item; item = item->next) {
+		device = URF_DEVICE (item->data);
+		name = urf_device_get_name (device);
+		g_variant_builder_add (&devices, "(iisbbb)",
+				       urf_device_get_index (device),
+				       urf_device_get_device_type (device),
+				       name ? name : "",
+				       urf_device_is_platform (device),
+				       urf_device_is_software_blocked (device),
+				       urf_device_is_hardware_blocked (device));
+	}
 
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(a(ii)a(iisbbb))",
+							      &killswitches,
+							      &devices));
 	return TRUE;
 }
 
 /**
- * flight_mode_cb:
+ * urf_daemon_get_managed_objects:
+ *
+ * org.freedesktop.DBus.ObjectManager.GetManagedObjects: every killswitch
+ * and device with all their interfaces and properties in one reply.
  **/
-static void
-flight_mode_cb (GObject *source,
-		GAsyncResult *res,
-		gpointer user_data)
+gboolean
+urf_daemon_get_managed_objects (UrfDaemon             *daemon,
+				GDBusMethodInvocation *invocation)
 {
-	UrfDaemon        *daemon;
-	UrfDaemonPrivate *priv;
-	GError            *error = NULL;
+	UrfDaemonPrivate *priv = daemon->priv;
+	UrfKillswitch *killswitch;
+	UrfDevice *device;
+	GVariantBuilder builder;
+	GList *item;
+	gint type;
 
-	g_assert (URF_IS_DAEMON (source));
-	daemon = URF_DAEMON(source);
+	g_return_val_if_fail (URF_IS_DAEMON (daemon), FALSE);
 
-	g_assert (g_task_is_valid (res, source));
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sa{sv}}}"));
 
-	priv = daemon->priv;
+	for (type = RFKILL_TYPE_ALL + 1; type < NUM_RFKILL_TYPES; type++) {
+		killswitch = urf_arbitrator_get_killswitch (priv->arbitrator, type);
+		if (killswitch == NULL)
+			continue;
+		g_variant_builder_add (&builder, "{o@a{sa{sv}}}",
+				       urf_killswitch_get_object_path (killswitch),
+				       urf_killswitch_get_managed_interfaces (killswitch));
+	}
 
-	g_task_propagate_pointer (G_TASK (res), &error);
-	g_object_unref (G_TASK (res));
+	for (item = urf_arbitrator_get_devices (priv->arbitrator); item; item = item->next) {
+		device = URF_DEVICE (item->data);
+		g_variant_builder_add (&builder, "{o@a{sa{sv}}}",
+				       urf_device_get_object_path (device),
+				       urf_device_get_managed_interfaces (device));
+	}
 
-	if (error == NULL) {
-		g_debug ("%s: success", __func__);
+	g_dbus_method_invocation_return_value (invocation,
+					       g_variant_new ("(a{oa{sa{sv}}})", &builder));
+	return TRUE;
+}
 
-		priv->flight_mode = priv->pending_block;
-		urf_config_set_persist_state (priv->config, RFKILL_TYPE_ALL,
-		                              priv->pending_block
-		                              ? KILLSWITCH_STATE_SOFT_BLOCKED
-		                              : KILLSWITCH_STATE_UNBLOCKED);
+/**
+ * urf_daemon_is_flight_mode:
+ **/
+gboolean
+urf_daemon_is_flight_mode (UrfDaemon             *daemon,
+			   GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	GVariant *value;
 
-		g_signal_emit (daemon, signals[SIGNAL_FLIGHT_MODE_CHANGED], 0, priv->flight_mode);
-		g_dbus_connection_emit_signal (priv->connection,
-		                               NULL,
-		                               URFKILL_OBJECT_PATH,
-		                               URFKILL_DBUS_INTERFACE,
-		                               "FlightModeChanged",
-		                               g_variant_new ("(b)", priv->flight_mode),
-		                               &error);
-		if (error) {
-			g_warning ("Failed to emit FlightModeChanged: %s", error->message);
-			g_error_free (error);
-		}
+	value = g_variant_new ("(b)", priv->flight_mode);
+	g_dbus_method_invocation_return_value (invocation, value);
 
-		g_dbus_method_invocation_return_value (priv->invocation,
-						       g_variant_new ("(b)", TRUE));
+	return TRUE;
+}
 
-	} else {
-		g_warning ("%s: failed to set device flight mode to %s", __func__,
-			   priv->pending_block ? "blocked" : "unblocked");
+/**
+ * urf_daemon_flight_mode_authorized:
+ **/
+static void
+urf_daemon_flight_mode_authorized (UrfDaemon             *daemon,
+				   const gboolean         block,
+				   GDBusMethodInvocation *invocation)
+{
+	urf_daemon_enqueue (daemon, URF_DAEMON_JOB_FLIGHT_MODE, 0,
+			    RFKILL_TYPE_ALL, block, invocation);
+}
 
-		g_dbus_method_invocation_return_error (priv->invocation,
-						       error->domain,
-		                                       error->code,
-						       "%s", error->message);
-		g_error_free (error);
-		error = NULL;
-	}
+/**
+ * urf_daemon_flight_mode_auth_cb:
+ **/
+static void
+urf_daemon_flight_mode_auth_cb (GObject      *source,
+				GAsyncResult *res,
+				gpointer      user_data)
+{
+	UrfDaemonRequest *request = user_data;
 
-	priv->invocation = NULL;
+	if (urf_daemon_request_authorized (request, res))
+		urf_daemon_flight_mode_authorized (request->daemon,
+						   request->block,
+						   request->invocation);
+	urf_daemon_request_free (request);
 }
 
 /**
@@ -623,59 +1055,19 @@ urf_daemon_flight_mode (UrfDaemon             *daemon,
 			GDBusMethodInvocation *invocation)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	PolkitSubject *subject = NULL;
-	GTask *task;
-	gint error = 0;
-	gboolean done = FALSE;
 
 	g_debug ("%s: block: %u", __func__, block);
 
-	if (!urf_arbitrator_has_devices (priv->arbitrator))
-		goto out;
-
-	subject = urf_polkit_get_subject (priv->polkit, invocation);
-	if (subject == NULL)
-		goto out;
-
-	if (!urf_polkit_check_auth (priv->polkit, subject, "org.freedesktop.urfkill.flight_mode", invocation))
-		goto out;
-
-	if (priv->invocation != NULL) {
-		g_debug ("%s: operation already inprogress...", __func__);
-
-		error = URF_DAEMON_ERROR_IN_PROGRESS;
-
-		goto out;
-	}
-
-	if (priv->flight_mode == block) {
-		g_debug ("%s: flight_mode == block", __func__);
-
-		done = TRUE;
-
-		goto out;
-	}
-
-	priv->pending_block = block;
-	priv->invocation = invocation;
-
-	task = g_task_new (daemon, NULL, flight_mode_cb, NULL);
-
-	urf_arbitrator_flight_mode (priv->arbitrator, block, task);
-
-out:
-	if (subject != NULL)
-		g_object_unref (subject);
-
-	if (error) {
-		g_dbus_method_invocation_return_error (invocation,
-						       URF_DAEMON_ERROR,
-						       error,
-						       "operation already in progress");
-	} else if (done) {
+	if (!urf_arbitrator_has_devices (priv->arbitrator)) {
 		g_dbus_method_invocation_return_value (invocation,
 						       g_variant_new ("(b)", TRUE));
+		return;
 	}
+
+	urf_polkit_check_auth_async (priv->polkit, invocation,
+				     "org.freedesktop.urfkill.flight_mode", NULL,
+				     urf_daemon_flight_mode_auth_cb,
+				     urf_daemon_request_new (daemon, invocation, 0, block));
 }
 
 /**
@@ -746,6 +1138,9 @@ handle_method_call_main (UrfDaemon             *daemon,
 	} else if (g_strcmp0 (method_name, "EnumerateDevices") == 0) {
 		urf_daemon_enumerate_devices (daemon, invocation);
 		return;
+	} else if (g_strcmp0 (method_name, "GetAllStates") == 0) {
+		urf_daemon_get_all_states (daemon, invocation);
+		return;
 	} else if (g_strcmp0 (method_name, "IsFlightMode") == 0) {
 		urf_daemon_is_flight_mode (daemon, invocation);
 		return;
@@ -789,6 +1184,9 @@ handle_method_call (GDBusConnection       *connection,
 		                         method_name,
 		                         parameters,
 		                         invocation);
+	} else if (g_strcmp0 (interface_name, OBJECT_MANAGER_INTERFACE) == 0 &&
+	           g_strcmp0 (method_name, "GetManagedObjects") == 0) {
+		urf_daemon_get_managed_objects (daemon, invocation);
 	} else {
 		g_warning ("not recognised interface: %s", interface_name);
 	}
@@ -853,6 +1251,15 @@ urf_daemon_register_rfkill_daemon (UrfDaemon *daemon)
 		                                    NULL);
 	g_assert (reg_id > 0);
 
+	reg_id = g_dbus_connection_register_object (priv->connection,
+		                                    URFKILL_OBJECT_PATH,
+		                                    infos[1],
+		                                    &interface_vtable,
+		                                    daemon,
+		                                    NULL,
+		                                    NULL);
+	g_assert (reg_id > 0);
+
 	return TRUE;
 }
 
@@ -899,6 +1306,111 @@ out:
 	return ret;
 }
 
+/**
+ * urf_daemon_find_device:
+ *
+ * Device object paths end with the rfkill index, which the arbitrator
+ * has indexed.
+ *
+ * Return value: a new reference to the device at @object_path, or %NULL
+ **/
+static UrfDevice *
+urf_daemon_find_device (UrfDaemon  *daemon,
+			const char *object_path)
+{
+	const char *node;
+	char *end;
+	guint64 index;
+
+	node = strrchr (object_path, '/');
+	if (node == NULL || node[1] == '\0')
+		return NULL;
+
+	index = g_ascii_strtoull (node + 1, &end, 10);
+	if (*end != '\0' || index > G_MAXINT)
+		return NULL;
+
+	return urf_arbitrator_get_device (daemon->priv->arbitrator, (gint) index);
+}
+
+/**
+ * urf_daemon_emit_interfaces_added:
+ **/
+static void
+urf_daemon_emit_interfaces_added (UrfDaemon  *daemon,
+				  const char *object_path)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	UrfDevice *device;
+	GVariant *interfaces;
+	GVariantIter iter;
+	GPtrArray *names;
+	const char *name;
+	GError *error = NULL;
+
+	device = urf_daemon_find_device (daemon, object_path);
+	if (device == NULL)
+		return;
+
+	interfaces = g_variant_ref_sink (urf_device_get_managed_interfaces (device));
+
+	/* Remember the interfaces for InterfacesRemoved, the device is
+	 * gone by the time we hear about its removal */
+	names = g_ptr_array_new ();
+	g_variant_iter_init (&iter, interfaces);
+	while (g_variant_iter_next (&iter, "{&s@a{sv}}", &name, NULL))
+		g_ptr_array_add (names, g_strdup (name));
+	g_ptr_array_add (names, NULL);
+	g_hash_table_replace (priv->managed_interfaces,
+			      g_strdup (object_path),
+			      g_ptr_array_free (names, FALSE));
+
+	g_dbus_connection_emit_signal (priv->connection,
+	                               NULL,
+	                               URFKILL_OBJECT_PATH,
+	                               OBJECT_MANAGER_INTERFACE,
+	                               "InterfacesAdded",
+	                               g_variant_new ("(o@a{sa{sv}})", object_path, interfaces),
+	                               &error);
+	if (error) {
+		g_warning ("Failed to emit InterfacesAdded: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_variant_unref (interfaces);
+	g_object_unref (device);
+}
+
+/**
+ * urf_daemon_emit_interfaces_removed:
+ **/
+static void
+urf_daemon_emit_interfaces_removed (UrfDaemon  *daemon,
+				    const char *object_path)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	const gchar * const *names;
+	GError *error = NULL;
+
+	names = g_hash_table_lookup (priv->managed_interfaces, object_path);
+	if (names == NULL)
+		return;
+
+	g_dbus_connection_emit_signal (priv->connection,
+	                               NULL,
+	                               URFKILL_OBJECT_PATH,
+	                               OBJECT_MANAGER_INTERFACE,
+	                               "InterfacesRemoved",
+	                               g_variant_new ("(o^as)", object_path, names),
+	                               &error);
+	if (error) {
+		g_warning ("Failed to emit InterfacesRemoved: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_hash_table_remove (priv->managed_interfaces, object_path);
+}
+
 /**
  * urf_daemon_device_added_cb:
  **/
@@ -929,6 +1441,8 @@ urf_daemon_device_added_cb (UrfArbitrator *arbitrator,
 		g_warning ("Failed to emit DeviceAdded: %s", error->message);
 		g_error_free (error);
 	}
+
+	urf_daemon_emit_interfaces_added (daemon, object_path);
 }
 
 /**
@@ -948,6 +1462,8 @@ urf_daemon_device_removed_cb (UrfArbitrator *arbitrator,
 		g_warning ("Invalid object path");
 		return;
 	}
+	g_hash_table_remove (priv->changed_devices, object_path);
+
 	g_signal_emit (daemon, signals[SIGNAL_DEVICE_REMOVED], 0, object_path);
 	g_dbus_connection_emit_signal (priv->connection,
 	                               NULL,
@@ -960,6 +1476,40 @@ urf_daemon_device_removed_cb (UrfArbitrator *arbitrator,
 		g_warning ("Failed to emit DeviceRemoved: %s", error->message);
 		g_error_free (error);
 	}
+
+	urf_daemon_emit_interfaces_removed (daemon, object_path);
+}
+
+/**
+ * urf_daemon_emit_device_changed:
+ *
+ * Called by the signal scheduler once per idle cycle.
+ **/
+static void
+urf_daemon_emit_device_changed (GObject *object)
+{
+	UrfDaemon *daemon = URF_DAEMON (object);
+	UrfDaemonPrivate *priv = daemon->priv;
+	GHashTableIter iter;
+	gpointer object_path;
+	GError *error = NULL;
+
+	g_hash_table_iter_init (&iter, priv->changed_devices);
+	while (g_hash_table_iter_next (&iter, &object_path, NULL)) {
+		g_dbus_connection_emit_signal (priv->connection,
+		                               NULL,
+		                               URFKILL_OBJECT_PATH,
+		                               URFKILL_DBUS_INTERFACE,
+		                               "DeviceChanged",
+		                               g_variant_new ("(o)", object_path),
+		                               &error);
+		if (error) {
+			g_warning ("Failed to emit DeviceChanged: %s", error->message);
+			g_clear_error (&error);
+		}
+	}
+
+	g_hash_table_remove_all (priv->changed_devices);
 }
 
 /**
@@ -971,7 +1521,6 @@ urf_daemon_device_changed_cb (UrfArbitrator *arbitrator,
 			      UrfDaemon     *daemon)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	GError *error = NULL;
 
 	g_return_if_fail (URF_IS_DAEMON (daemon));
 	g_return_if_fail (URF_IS_ARBITRATOR (arbitrator));
@@ -980,17 +1529,11 @@ urf_daemon_device_changed_cb (UrfArbitrator *arbitrator,
 		return;
 	}
 	g_signal_emit (daemon, signals[SIGNAL_DEVICE_CHANGED], 0, object_path);
-	g_dbus_connection_emit_signal (priv->connection,
-	                               NULL,
-	                               URFKILL_OBJECT_PATH,
-	                               URFKILL_DBUS_INTERFACE,
-	                               "DeviceChanged",
-	                               g_variant_new ("(o)", object_path),
-	                               &error);
-	if (error) {
-		g_warning ("Failed to emit DeviceChanged: %s", error->message);
-		g_error_free (error);
-	}
+
+	/* one DeviceChanged per device, however many events it got */
+	g_hash_table_add (priv->changed_devices, g_strdup (object_path));
+	urf_signal_scheduler_queue (G_OBJECT (daemon),
+				    urf_daemon_emit_device_changed);
 }
 
 /**
@@ -1001,6 +1544,15 @@ urf_daemon_init (UrfDaemon *daemon)
 {
 	daemon->priv = URF_DAEMON_GET_PRIVATE (daemon);
 	daemon->priv->polkit = urf_polkit_new ();
+	daemon->priv->pending_jobs = g_queue_new ();
+	daemon->priv->changed_devices = g_hash_table_new_full (g_str_hash,
+							       g_str_equal,
+							       g_free,
+							       NULL);
+	daemon->priv->managed_interfaces = g_hash_table_new_full (g_str_hash,
+								  g_str_equal,
+								  g_free,
+								  (GDestroyNotify) g_strfreev);
 
 	daemon->priv->arbitrator = urf_arbitrator_new ();
 	g_signal_connect (daemon->priv->arbitrator, "device-added",
@@ -1147,6 +1699,9 @@ urf_daemon_dispose (GObject *object)
 	}
 
 	if (priv->polkit) {
+		g_debug ("polkit authorizations: %u cached, %u checked",
+			 urf_polkit_get_cache_hits (priv->polkit),
+			 urf_polkit_get_cache_misses (priv->polkit));
 		g_object_unref (priv->polkit);
 		priv->polkit = NULL;
 	}
@@ -1171,6 +1726,32 @@ urf_daemon_dispose (GObject *object)
 		priv->introspection_data = NULL;
 	}
 
+	if (priv->pending_jobs) {
+		GError *error;
+
+		error = g_error_new_literal (URF_DAEMON_ERROR,
+					     URF_DAEMON_ERROR_GENERAL,
+					     "daemon is shutting down");
+		while (!g_queue_is_empty (priv->pending_jobs)) {
+			UrfDaemonJob *job = g_queue_pop_head (priv->pending_jobs);
+			urf_daemon_job_return (job, error);
+			urf_daemon_job_free (job);
+		}
+		g_error_free (error);
+		g_queue_free (priv->pending_jobs);
+		priv->pending_jobs = NULL;
+	}
+
+	if (priv->changed_devices) {
+		g_hash_table_destroy (priv->changed_devices);
+		priv->changed_devices = NULL;
+	}
+
+	if (priv->managed_interfaces) {
+		g_hash_table_destroy (priv->managed_interfaces);
+		priv->managed_interfaces = NULL;
+	}
+
 	G_OBJECT_CLASS (urf_daemon_parent_class)->dispose (object);
 }
 
@@ -74,6 +74,10 @@ void		 urf_daemon_block_idx		(UrfDaemon		*daemon,
 						 GDBusMethodInvocation  *invocation);
 gboolean	 urf_daemon_enumerate_devices	(UrfDaemon		*daemon,
 						 GDBusMethodInvocation  *invocation);
+gboolean	 urf_daemon_get_all_states	(UrfDaemon		*daemon,
+						 GDBusMethodInvocation  *invocation);
+gboolean	 urf_daemon_get_managed_objects	(UrfDaemon		*daemon,
+						 GDBusMethodInvocation  *invocation);
 gboolean	 urf_daemon_is_flight_mode	(UrfDaemon		*daemon,
 						 GDBusMethodInvocation  *invocation);
 void     	 urf_daemon_flight_mode	        (UrfDaemon		*daemon,
@@ -63,8 +63,22 @@ struct _UrfDeviceHybrisPrivate {
 	char *name;
 
 	gboolean soft;
+	gboolean busy;		/* a driver operation is running */
+	GQueue pending_ops;	/* HybrisOp waiting for it, in order */
 };
 
+/*
+ * One wifi_load_driver()/wifi_unload_driver() call. Loading the module
+ * takes seconds on some devices, so it runs in a worker thread; the
+ * result is applied back in the main context.
+ */
+typedef struct {
+	gboolean blocked;
+	GTask *task;		/* the caller's task, may be NULL */
+	int res;
+	gboolean soft;
+} HybrisOp;
+
 G_DEFINE_TYPE_WITH_PRIVATE (UrfDeviceHybris, urf_device_hybris, URF_TYPE_DEVICE)
 
 /**
@@ -120,42 +134,115 @@ static inline int is_soft_blocked()
 	return !is_wifi_driver_loaded();
 }
 
+static void run_next_op (UrfDeviceHybris *hybris);
+
 /**
- * set_soft:
+ * hybris_op_thread:
  **/
 static void
-set_soft (UrfDevice *device, gboolean blocked, GTask *task)
+hybris_op_thread (GTask        *worker,
+		  gpointer      source_object,
+		  gpointer      task_data,
+		  GCancellable *cancellable)
 {
-	UrfDeviceHybris *hybris = URF_DEVICE_HYBRIS (device);
-	UrfDeviceHybrisPrivate *priv = URF_DEVICE_HYBRIS_GET_PRIVATE (hybris);
-	int res;
-	gboolean prev_blocked = priv->soft;
+	HybrisOp *op = task_data;
 
-	if (blocked)
-		res = wifi_unload_driver();
+	if (op->blocked)
+		op->res = wifi_unload_driver();
 	else
-		res = wifi_load_driver();
+		op->res = wifi_load_driver();
 
-	priv->soft = is_soft_blocked();
+	op->soft = is_soft_blocked();
+
+	g_task_return_boolean (worker, TRUE);
+}
+
+/**
+ * hybris_op_done_cb:
+ **/
+static void
+hybris_op_done_cb (GObject      *source,
+		   GAsyncResult *res,
+		   gpointer      user_data)
+{
+	UrfDeviceHybris *hybris = URF_DEVICE_HYBRIS (source);
+	UrfDeviceHybrisPrivate *priv = URF_DEVICE_HYBRIS_GET_PRIVATE (hybris);
+	HybrisOp *op = g_task_get_task_data (G_TASK (res));
+	gboolean prev_blocked = priv->soft;
+
+	priv->soft = op->soft;
 
 	if (prev_blocked != priv->soft)
-		g_signal_emit_by_name(G_OBJECT (device), "state-changed", 0);
+		g_signal_emit_by_name(G_OBJECT (hybris), "state-changed", 0);
 
-	if (res < 0) {
-		g_warning ("Error setting hybris_wifi soft to %d", blocked);
+	if (op->res < 0) {
+		g_warning ("Error setting hybris_wifi soft to %d", op->blocked);
 
-		if (task)
-			g_task_return_new_error(task,
+		if (op->task)
+			g_task_return_new_error(op->task,
 						URF_DAEMON_ERROR,
 						URF_DAEMON_ERROR_GENERAL,
 						"set_soft failed hybris Wi-Fi");
 	} else {
-		g_message ("hybris_wifi soft blocked set to %d", blocked);
-
-		if (task)
-			g_task_return_pointer (task, NULL, NULL);
+		g_message ("hybris_wifi soft blocked set to %d", op->blocked);
 
+		if (op->task)
+			g_task_return_pointer (op->task, NULL, NULL);
 	}
+
+	g_object_unref (G_TASK (res));
+
+	priv->busy = FALSE;
+	run_next_op (hybris);
+}
+
+/**
+ * run_next_op:
+ *
+ * Driver operations never overlap: they run one at a time in the order
+ * they were requested.
+ **/
+static void
+run_next_op (UrfDeviceHybris *hybris)
+{
+	UrfDeviceHybrisPrivate *priv = URF_DEVICE_HYBRIS_GET_PRIVATE (hybris);
+	HybrisOp *op;
+	GTask *worker;
+
+	if (priv->busy)
+		return;
+
+	op = g_queue_pop_head (&priv->pending_ops);
+	if (op == NULL)
+		return;
+
+	priv->busy = TRUE;
+
+	worker = g_task_new (hybris, NULL, hybris_op_done_cb, NULL);
+	g_task_set_task_data (worker, op, g_free);
+	g_task_run_in_thread (worker, hybris_op_thread);
+}
+
+/**
+ * set_soft:
+ **/
+static void
+set_soft (UrfDevice *device, gboolean blocked, GTask *task)
+{
+	UrfDeviceHybris *hybris = URF_DEVICE_HYBRIS (device);
+	UrfDeviceHybrisPrivate *priv = URF_DEVICE_HYBRIS_GET_PRIVATE (hybris);
+	HybrisOp *op;
+
+	op = g_new0 (HybrisOp, 1);
+	op->blocked = blocked;
+	op->task = task;
+
+	if (priv->busy)
+		g_debug ("hybris_wifi busy, queueing soft %d (%u waiting)",
+			 blocked, g_queue_get_length (&priv->pending_ops) + 1);
+
+	g_queue_push_tail (&priv->pending_ops, op);
+	run_next_op (hybris);
 }
 
 /**
@@ -243,6 +330,8 @@ urf_device_hybris_init (UrfDeviceHybris *device)
 	UrfDeviceHybrisPrivate *priv = URF_DEVICE_HYBRIS_GET_PRIVATE (device);
 
 	priv->soft = is_soft_blocked();
+	priv->busy = FALSE;
+	g_queue_init (&priv->pending_ops);
 }
 
 /**
@@ -27,8 +27,6 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <fcntl.h>
-#include <errno.h>
 #include <glib.h>
 #include <gio/gio.h>
 #include <libudev.h>
@@ -41,6 +39,8 @@
 
 #include "urf-daemon.h"
 #include "urf-device-kernel.h"
+#include "urf-kernel-batch.h"
+#include "urf-signal-scheduler.h"
 #include "urf-utils.h"
 
 #define URF_DEVICE_KERNEL_INTERFACE "org.freedesktop.URfkill.Device.Kernel"
@@ -66,15 +66,20 @@ enum
 struct _UrfDeviceKernelPrivate {
 	gint		 index;
 	gint		 type;
-	char		*name;
+	char		*name;		/* resolved on first use */
+	gboolean	 name_resolved;
 	gboolean	 soft;
 	gboolean	 hard;
+	gboolean	 emitted_soft;
+	gboolean	 emitted_hard;
 	gboolean	 platform;
-	int		 fd;
+	UrfKernelBatch	*batch;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (UrfDeviceKernel, urf_device_kernel, URF_TYPE_DEVICE)
 
+static void resolve_name (UrfDeviceKernel *device);
+
 /**
  * emit_properites_changed:
  **/
@@ -111,6 +116,41 @@ emit_properites_changed (UrfDeviceKernel *device)
 	}
 }
 
+/**
+ * emit_changed:
+ *
+ * Called by the signal scheduler once per idle cycle.
+ **/
+static void
+emit_changed (GObject *object)
+{
+	UrfDeviceKernel *device = URF_DEVICE_KERNEL (object);
+	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
+	GError *error = NULL;
+
+	/* the blocks may have gone back to what was last announced */
+	if (priv->emitted_soft == priv->soft &&
+	    priv->emitted_hard == priv->hard)
+		return;
+
+	priv->emitted_soft = priv->soft;
+	priv->emitted_hard = priv->hard;
+
+	emit_properites_changed (device);
+
+	g_dbus_connection_emit_signal (urf_device_get_connection (URF_DEVICE (device)),
+	                               NULL,
+				       urf_device_get_object_path (URF_DEVICE (device)),
+	                               URF_DEVICE_KERNEL_INTERFACE,
+	                               "Changed",
+	                               NULL,
+	                               &error);
+	if (error) {
+		g_warning ("Failed to emit Changed: %s", error->message);
+		g_error_free (error);
+	}
+}
+
 /**
  * urf_device_kernel_update_states:
  *
@@ -123,29 +163,16 @@ urf_device_kernel_update_states (UrfDevice *device,
                                  const gboolean  hard)
 {
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
-	GError *error = NULL;
 
 	if (priv->soft != soft || priv->hard != hard) {
 		priv->soft = soft;
 		priv->hard = hard;
 
-		g_debug("Emitting state-changed on device %s", priv->name);
+		g_debug("Emitting state-changed on device idx %d", priv->index);
 		g_signal_emit_by_name(G_OBJECT (device), "state-changed", 0);
 
-		emit_properites_changed (URF_DEVICE_KERNEL (device));
-
-		g_dbus_connection_emit_signal (urf_device_get_connection (device),
-		                               NULL,
-					       urf_device_get_object_path (device),
-		                               URF_DEVICE_KERNEL_INTERFACE,
-		                               "Changed",
-		                               NULL,
-		                               &error);
-		if (error) {
-			g_warning ("Failed to emit Changed: %s", error->message);
-			g_error_free (error);
-			return FALSE;
-		}
+		/* D-Bus signals are coalesced until the burst is over */
+		urf_signal_scheduler_queue (G_OBJECT (device), emit_changed);
 
 		return TRUE;
 	}
@@ -186,7 +213,12 @@ get_urf_type (UrfDevice *device)
 static const char *
 get_name (UrfDevice *device)
 {
-	return URF_DEVICE_KERNEL_GET_PRIVATE (device)->name;
+	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
+
+	if (!priv->name_resolved)
+		resolve_name (URF_DEVICE_KERNEL (device));
+
+	return priv->name;
 }
 
 /**
@@ -215,33 +247,15 @@ set_soft (UrfDevice *device, gboolean blocked, GTask *task)
 {
 	UrfDeviceKernel *self = URF_DEVICE_KERNEL (device);
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (self);
-	struct rfkill_event event;
-	ssize_t len;
-
-	memset (&event, 0, sizeof(event));
-	event.op = RFKILL_OP_CHANGE_ALL;
-	event.type = priv->type;
-	event.soft = blocked;
 
 	g_message ("%s: Setting %s to %s",
 		   __func__,
 	           type_to_string (priv->type),
 	           blocked ? "blocked" : "unblocked");
 
-	len = write (priv->fd, &event, sizeof(event));
-	if (len < 0) {
-		g_warning ("Failed to change RFKILL state: %s",
-			   g_strerror (errno));
-
-		if (task)
-			g_task_return_new_error(task,
-						URF_DAEMON_ERROR, 0,
-						"set_soft failed: %s",
-						type_to_string (priv->type));
-	} else {
-		if (task)
-			g_task_return_pointer (task, NULL, NULL);
-	}
+	/* written through the arbitrator's rfkill descriptor, coalesced
+	 * with the other requests of this main loop iteration */
+	urf_kernel_batch_queue (priv->batch, priv->type, blocked, task);
 }
 
 /**
@@ -344,6 +358,17 @@ constructor (GType type,
 static void
 dispose (GObject *object)
 {
+	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (object);
+
+	if (priv->batch) {
+		urf_kernel_batch_unregister_type (priv->batch, priv->type);
+		g_object_unref (priv->batch);
+		priv->batch = NULL;
+	}
+
+	g_free (priv->name);
+	priv->name = NULL;
+
 	G_OBJECT_CLASS(urf_device_kernel_parent_class)->dispose(object);
 }
 
@@ -354,18 +379,11 @@ static void
 urf_device_kernel_init (UrfDeviceKernel *device)
 {
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
-	int fd;
 
 	priv->name = NULL;
+	priv->name_resolved = FALSE;
 	priv->platform = FALSE;
-
-	fd = open("/dev/rfkill", O_RDWR | O_NONBLOCK);
-	if (fd < 0) {
-		if (errno == EACCES)
-			g_warning ("Could not open RFKILL control device");
-	}
-
-	priv->fd = fd;
+	priv->batch = NULL;
 }
 
 /**
@@ -457,56 +475,106 @@ static const GDBusInterfaceVTable interface_vtable =
 };
 
 /**
- * get_udev_attrs
+ * get_udev_device:
  */
-static void
-get_udev_attrs (UrfDeviceKernel *device)
+static struct udev_device *
+get_udev_device (UrfDeviceKernel *device)
 {
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
 	struct udev *udev;
 	struct udev_device *dev;
-	struct udev_device *parent_dev;
 
-	udev = udev_new ();
-	if (udev == NULL) {
-		g_warning ("udev_new() failed");
-		return;
-	}
+	udev = get_udev_context ();
+	if (udev == NULL)
+		return NULL;
+
 	dev = get_rfkill_device_by_index (udev, priv->index);
-	if (!dev) {
+	if (!dev)
 		g_warning ("Failed to get udev device for index %u", priv->index);
-		udev_unref (udev);
-		return;
-	}
 
-	priv->name = g_strdup (udev_device_get_sysattr_value (dev, "name"));
+	return dev;
+}
+
+/**
+ * resolve_platform:
+ *
+ * The killswitch needs to know whether the device is a platform one as
+ * soon as it is added, so this one can't wait.
+ */
+static void
+resolve_platform (UrfDeviceKernel *device)
+{
+	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
+	struct udev_device *dev;
+
+	dev = get_udev_device (device);
+	if (!dev)
+		return;
 
-	parent_dev = udev_device_get_parent_with_subsystem_devtype (dev, "platform", NULL);
-	if (parent_dev)
+	if (udev_device_get_parent_with_subsystem_devtype (dev, "platform", NULL))
 		priv->platform = TRUE;
 
 	udev_device_unref (dev);
-	udev_unref (udev);
+}
+
+/**
+ * resolve_name:
+ */
+static void
+resolve_name (UrfDeviceKernel *device)
+{
+	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
+	struct udev_device *dev;
+
+	priv->name_resolved = TRUE;
+
+	dev = get_udev_device (device);
+	if (!dev)
+		return;
+
+	priv->name = g_strdup (udev_device_get_sysattr_value (dev, "name"));
+
+	udev_device_unref (dev);
 }
 
 /**
  * urf_device_kernel_new:
+ * @info: udev attributes of the device when they are already known,
+ *        or %NULL to look them up
  */
 UrfDevice *
 urf_device_kernel_new (gint    index,
                        gint    type,
                        gboolean soft,
-                       gboolean hard)
+                       gboolean hard,
+                       UrfKernelBatch *batch,
+                       const RfkillDeviceInfo *info)
 {
-	UrfDeviceKernel *device = g_object_new (URF_TYPE_DEVICE_KERNEL, NULL);
-	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
+	UrfDeviceKernel *device;
+	UrfDeviceKernelPrivate *priv;
+
+	g_return_val_if_fail (URF_IS_KERNEL_BATCH (batch), NULL);
+
+	device = g_object_new (URF_TYPE_DEVICE_KERNEL, NULL);
+	priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
 
 	priv->index = index;
 	priv->type = type;
 	priv->soft = soft;
 	priv->hard = hard;
+	priv->emitted_soft = soft;
+	priv->emitted_hard = hard;
+
+	priv->batch = g_object_ref (batch);
+	urf_kernel_batch_register_type (batch, type);
 
-	get_udev_attrs (device);
+	if (info) {
+		priv->name = g_strdup (info->name);
+		priv->name_resolved = TRUE;
+		priv->platform = info->platform;
+	} else {
+		resolve_platform (device);
+	}
 
 	if (!urf_device_register_device (URF_DEVICE (device),
 					 interface_vtable,
@@ -23,6 +23,7 @@
 
 #include <glib-object.h>
 #include "urf-device.h"
+#include "urf-kernel-batch.h"
 #include "urf-utils.h"
 
 G_BEGIN_DECLS
@@ -54,7 +55,9 @@ GType			 urf_device_kernel_get_type		(void);
 UrfDevice		*urf_device_kernel_new			(gint			 index,
 								 gint			 type,
 								 gboolean		 soft,
-								 gboolean		 hard);
+								 gboolean		 hard,
+								 UrfKernelBatch		*batch,
+								 const RfkillDeviceInfo	*info);
 
 G_END_DECLS
 
@@ -24,6 +24,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <glib.h>
 #include <linux/rfkill.h>
 #include <gio/gio.h>
@@ -34,6 +35,7 @@
 #include "urf-utils.h"
 
 #define URF_DEVICE_INTERFACE "org.freedesktop.URfkill.Device"
+#define URF_DEVICE_BASE_PATH "/org/freedesktop/URfkill/devices"
 
 static const char introspection_generic[] =
 "  <interface name='org.freedesktop.URfkill.Device'>"
@@ -70,13 +72,19 @@ static int signals[LAST_SIGNAL] = { 0 };
 struct _UrfDevicePrivate {
 	char		*object_path;
 	GDBusConnection	*connection;
-	GDBusNodeInfo	*introspection_data;
-	guint            dev_iface_id;
-	guint            child_iface_id;
+	GDBusNodeInfo	*introspection_data; /* shared by the devices of a class */
+	GDBusInterfaceVTable child_vtable;
+	char		*node; /* name of the device below URF_DEVICE_BASE_PATH */
 };
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (UrfDevice, urf_device, G_TYPE_OBJECT)
 
+/* All devices are served by a single subtree registration */
+static GDBusConnection *bus_connection = NULL;
+static GHashTable *introspection_cache = NULL; /* class xml -> GDBusNodeInfo */
+static GHashTable *registered_devices = NULL; /* node -> UrfDevice */
+static guint subtree_id = 0;
+
 
 /**
  * urf_device_get_connection:
@@ -337,15 +345,14 @@ urf_device_dispose (GObject *object)
 		priv->introspection_data = NULL;
 	}
 
+	if (priv->node) {
+		if (g_hash_table_lookup (registered_devices, priv->node) == object)
+			g_hash_table_remove (registered_devices, priv->node);
+		g_free (priv->node);
+		priv->node = NULL;
+	}
+
 	if (priv->connection) {
-		if (priv->child_iface_id > 0)
-			g_dbus_connection_unregister_object (priv->connection,
-							     priv->child_iface_id);
-		if (priv->dev_iface_id > 0)
-			g_dbus_connection_unregister_object (priv->connection,
-							     priv->dev_iface_id);
-		priv->child_iface_id = 0;
-		priv->dev_iface_id = 0;
 		g_object_unref (priv->connection);
 		priv->connection = NULL;
 	}
@@ -482,78 +489,351 @@ static const GDBusInterfaceVTable interface_vtable =
 static char *
 urf_device_compute_object_path (UrfDevice *device)
 {
-	const char *path_template = "/org/freedesktop/URfkill/devices/%u";
+	const char *path_template = URF_DEVICE_BASE_PATH "/%u";
 
 	return g_strdup_printf (path_template, urf_device_get_index (device));
 }
 
 /**
- * urf_device_register_device:
+ * lookup_device:
+ *
+ * Find the device still registered at @object_path. GDBus only checks
+ * that the subtree is registered when it runs a handler, not the node.
  **/
-gboolean
-urf_device_register_device (UrfDevice *device, const GDBusInterfaceVTable vtable, const char *xml)
+static UrfDevice *
+lookup_device (const gchar  *object_path,
+	       GError      **error)
+{
+	const char *prefix = URF_DEVICE_BASE_PATH "/";
+	UrfDevice *device = NULL;
+
+	if (registered_devices != NULL && g_str_has_prefix (object_path, prefix))
+		device = g_hash_table_lookup (registered_devices,
+					      object_path + strlen (prefix));
+
+	if (device == NULL)
+		g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT,
+			     "No device at %s", object_path);
+
+	return device;
+}
+
+/**
+ * lookup_vtable:
+ *
+ * Return value: the vtable of @device serving @interface_name
+ **/
+static const GDBusInterfaceVTable *
+lookup_vtable (UrfDevice   *device,
+	       const gchar *interface_name)
 {
 	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (device);
-	GDBusInterfaceInfo **infos;
-	guint reg_id;
+	GDBusInterfaceInfo **infos = priv->introspection_data->interfaces;
+
+	if (g_strcmp0 (interface_name, infos[0]->name) == 0)
+		return &interface_vtable;
+	else if (g_strcmp0 (interface_name, infos[1]->name) == 0)
+		return &priv->child_vtable;
+
+	return NULL;
+}
+
+static void
+device_method_call (GDBusConnection *connection,
+                    const gchar *sender,
+                    const gchar *object_path,
+                    const gchar *interface_name,
+                    const gchar *method_name,
+                    GVariant *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer user_data)
+{
+	const GDBusInterfaceVTable *vtable;
+	UrfDevice *device;
 	GError *error = NULL;
+
+	device = lookup_device (object_path, &error);
+	if (device == NULL) {
+		g_dbus_method_invocation_take_error (invocation, error);
+		return;
+	}
+
+	vtable = lookup_vtable (device, interface_name);
+	if (vtable == NULL || vtable->method_call == NULL) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_UNKNOWN_METHOD,
+						       "No such method %s", method_name);
+		return;
+	}
+
+	vtable->method_call (connection, sender, object_path, interface_name,
+			     method_name, parameters, invocation, device);
+}
+
+static GVariant *
+device_get_property (GDBusConnection *connection,
+                     const gchar *sender,
+                     const gchar *object_path,
+                     const gchar *interface_name,
+                     const gchar *property_name,
+                     GError **error,
+                     gpointer user_data)
+{
+	const GDBusInterfaceVTable *vtable;
+	UrfDevice *device;
+
+	device = lookup_device (object_path, error);
+	if (device == NULL)
+		return NULL;
+
+	vtable = lookup_vtable (device, interface_name);
+	if (vtable == NULL || vtable->get_property == NULL) {
+		g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+			     "No such property %s", property_name);
+		return NULL;
+	}
+
+	return vtable->get_property (connection, sender, object_path,
+				     interface_name, property_name,
+				     error, device);
+}
+
+static gboolean
+device_set_property (GDBusConnection *connection,
+                     const gchar *sender,
+                     const gchar *object_path,
+                     const gchar *interface_name,
+                     const gchar *property_name,
+                     GVariant *value,
+                     GError **error,
+                     gpointer user_data)
+{
+	const GDBusInterfaceVTable *vtable;
+	UrfDevice *device;
+
+	device = lookup_device (object_path, error);
+	if (device == NULL)
+		return FALSE;
+
+	vtable = lookup_vtable (device, interface_name);
+	if (vtable == NULL || vtable->set_property == NULL) {
+		g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_PROPERTY_READ_ONLY,
+			     "Property %s is read-only", property_name);
+		return FALSE;
+	}
+
+	return vtable->set_property (connection, sender, object_path,
+				     interface_name, property_name,
+				     value, error, device);
+}
+
+/* Looks the device up again when the call is handled */
+static const GDBusInterfaceVTable device_vtable =
+{
+	device_method_call,
+	device_get_property,
+	device_set_property,
+};
+
+static gchar **
+subtree_enumerate (GDBusConnection *connection,
+                   const gchar *sender,
+                   const gchar *object_path,
+                   gpointer user_data)
+{
+	GPtrArray *nodes;
+	GHashTableIter iter;
+	gpointer key;
+
+	nodes = g_ptr_array_new ();
+	g_hash_table_iter_init (&iter, registered_devices);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		g_ptr_array_add (nodes, g_strdup (key));
+	g_ptr_array_add (nodes, NULL);
+
+	return (gchar **) g_ptr_array_free (nodes, FALSE);
+}
+
+static GDBusInterfaceInfo **
+subtree_introspect (GDBusConnection *connection,
+                    const gchar *sender,
+                    const gchar *object_path,
+                    const gchar *node,
+                    gpointer user_data)
+{
+	UrfDevicePrivate *priv;
+	UrfDevice *device;
+	GPtrArray *infos;
+	guint i;
+
+	if (node == NULL)
+		return NULL;
+
+	device = g_hash_table_lookup (registered_devices, node);
+	if (device == NULL)
+		return NULL;
+
+	priv = URF_DEVICE_GET_PRIVATE (device);
+	infos = g_ptr_array_new ();
+	for (i = 0; priv->introspection_data->interfaces[i]; i++)
+		g_ptr_array_add (infos, g_dbus_interface_info_ref (priv->introspection_data->interfaces[i]));
+	g_ptr_array_add (infos, NULL);
+
+	return (GDBusInterfaceInfo **) g_ptr_array_free (infos, FALSE);
+}
+
+static const GDBusInterfaceVTable *
+subtree_dispatch (GDBusConnection *connection,
+                  const gchar *sender,
+                  const gchar *object_path,
+                  const gchar *interface_name,
+                  const gchar *node,
+                  gpointer *out_user_data,
+                  gpointer user_data)
+{
+	UrfDevice *device;
+
+	if (node == NULL)
+		return NULL;
+
+	device = g_hash_table_lookup (registered_devices, node);
+	if (device == NULL || lookup_vtable (device, interface_name) == NULL)
+		return NULL;
+
+	/* The handlers run from an idle, by then the device may be gone */
+	*out_user_data = NULL;
+
+	return &device_vtable;
+}
+
+static const GDBusSubtreeVTable subtree_vtable =
+{
+	subtree_enumerate,
+	subtree_introspect,
+	subtree_dispatch,
+};
+
+/**
+ * urf_device_get_introspection_data:
+ *
+ * The introspection data only depends on the class, so parse it once
+ * for all the devices sharing @xml.
+ **/
+static GDBusNodeInfo *
+urf_device_get_introspection_data (const char *xml)
+{
+	GDBusNodeInfo *node_info;
 	GString *introspection_xml;
 	gchar *xml_data;
 
+	if (introspection_cache == NULL)
+		introspection_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+							     (GDestroyNotify) g_dbus_node_info_unref);
+
+	node_info = g_hash_table_lookup (introspection_cache, xml);
+	if (node_info)
+		return g_dbus_node_info_ref (node_info);
+
 	introspection_xml = g_string_new ("<node>");
 	introspection_xml = g_string_append (introspection_xml, introspection_generic);
 	introspection_xml = g_string_append (introspection_xml, xml);
 	introspection_xml = g_string_append (introspection_xml, "</node>");
 	xml_data = g_string_free (introspection_xml, FALSE);
 
-	priv->introspection_data = g_dbus_node_info_new_for_xml (xml_data, NULL);
-	g_assert (priv->introspection_data != NULL);
+	node_info = g_dbus_node_info_new_for_xml (xml_data, NULL);
+	g_assert (node_info != NULL);
 	g_free (xml_data);
 
-	priv->connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
-	if (priv->connection == NULL) {
-		g_error ("error getting system bus: %s", error->message);
-		g_error_free (error);
-		return FALSE;
-	}
+	g_hash_table_insert (introspection_cache, (gpointer) xml, node_info);
 
-	error = NULL;
+	return g_dbus_node_info_ref (node_info);
+}
 
-	priv->object_path = urf_device_compute_object_path (device);
-	g_debug ("%s: priv->object_path: %s", __func__, priv->object_path);
+/**
+ * urf_device_register_device:
+ *
+ * @xml must be a string with static storage, it identifies the class.
+ **/
+gboolean
+urf_device_register_device (UrfDevice *device, const GDBusInterfaceVTable vtable, const char *xml)
+{
+	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (device);
+	GError *error = NULL;
 
-	infos = priv->introspection_data->interfaces;
+	priv->introspection_data = urf_device_get_introspection_data (xml);
+	priv->child_vtable = vtable;
 
-	reg_id = g_dbus_connection_register_object (priv->connection,
-		                                    priv->object_path,
-		                                    infos[0],
-		                                    &interface_vtable,
-		                                    device,
-		                                    NULL,
-		                                    &error);
+	if (bus_connection == NULL) {
+		bus_connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+		if (bus_connection == NULL) {
+			g_error ("error getting system bus: %s", error->message);
+			g_error_free (error);
+			return FALSE;
+		}
+	}
+	priv->connection = g_object_ref (bus_connection);
+
+	if (subtree_id == 0) {
+		registered_devices = g_hash_table_new_full (g_str_hash, g_str_equal,
+							    g_free, NULL);
+		subtree_id = g_dbus_connection_register_subtree (bus_connection,
+								 URF_DEVICE_BASE_PATH,
+								 &subtree_vtable,
+								 G_DBUS_SUBTREE_FLAGS_NONE,
+								 NULL,
+								 NULL,
+								 &error);
+		if (error != NULL) {
+			g_warning ("Error registering devices subtree: %s", error->message);
+			g_error_free (error);
+		}
+
+		g_assert (subtree_id > 0);
+	}
 
-	if (error != NULL)
-		g_warning ("Error registering Device interface: %s", error->message);
+	priv->object_path = urf_device_compute_object_path (device);
+	g_debug ("%s: priv->object_path: %s", __func__, priv->object_path);
 
-	g_assert (reg_id > 0);
+	priv->node = g_strdup (priv->object_path + strlen (URF_DEVICE_BASE_PATH "/"));
+	g_hash_table_insert (registered_devices, g_strdup (priv->node), device);
 
-	priv->dev_iface_id = reg_id;
+	return TRUE;
+}
 
-	reg_id = g_dbus_connection_register_object (priv->connection,
-		                                    priv->object_path,
-		                                    infos[1],
-		                                    &vtable,
-		                                    device,
-		                                    NULL,
-		                                    &error);
-	if (error != NULL)
-		g_warning ("Error registering Device interface: %s", error->message);
+/**
+ * urf_device_get_managed_interfaces:
+ *
+ * Return value: a floating a{sa{sv}} #GVariant with all the interfaces
+ *               of @device and their properties
+ **/
+GVariant *
+urf_device_get_managed_interfaces (UrfDevice *device)
+{
+	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (device);
+	GDBusInterfaceInfo **infos;
+	GVariantBuilder builder;
 
-	g_assert (reg_id > 0);
+	g_return_val_if_fail (URF_IS_DEVICE (device), NULL);
+	g_return_val_if_fail (priv->introspection_data != NULL, NULL);
 
-	priv->child_iface_id = reg_id;
+	infos = priv->introspection_data->interfaces;
 
-	return TRUE;
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+	g_variant_builder_add (&builder, "{s@a{sv}}", infos[0]->name,
+			       get_interface_properties (priv->connection,
+							 priv->object_path,
+							 infos[0],
+							 &interface_vtable,
+							 device));
+	g_variant_builder_add (&builder, "{s@a{sv}}", infos[1]->name,
+			       get_interface_properties (priv->connection,
+							 priv->object_path,
+							 infos[1],
+							 &priv->child_vtable,
+							 device));
+
+	return g_variant_builder_end (&builder);
 }
 
 /**
@@ -101,6 +101,7 @@ gboolean		 urf_device_is_software_blocked	(UrfDevice	*device);
 gboolean		 urf_device_register_device	(UrfDevice			*device,
 							 const GDBusInterfaceVTable	 vtable,
 							 const char			*xml);
+GVariant		*urf_device_get_managed_interfaces (UrfDevice		*device);
 
 G_END_DECLS
 
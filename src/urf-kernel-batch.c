@@ -0,0 +1,367 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Canonical Ltd.
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Soft block requests for kernel rfkill devices are not written to
+ * /dev/rfkill straight away. They are queued here and written from an
+ * idle callback, so every request made during one main loop iteration
+ * (e.g. one per device of a killswitch, or one per killswitch in flight
+ * mode) ends up in as few RFKILL_OP_CHANGE_ALL writes as possible: one
+ * per type, or a single RFKILL_TYPE_ALL write when every type that has
+ * kernel devices is set to the same state.
+ *
+ * The batch writes through the descriptor the arbitrator reads events
+ * from, and kernel devices hold a reference on it rather than opening
+ * /dev/rfkill themselves.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <linux/rfkill.h>
+
+#include "urf-daemon.h"
+#include "urf-kernel-batch.h"
+#include "urf-utils.h"
+
+struct _UrfKernelBatch {
+	GObject parent_instance;
+
+	int fd;
+	gboolean allow_type_all;
+	guint idle_id;
+
+	/* number of kernel devices of each type */
+	guint registered[NUM_RFKILL_TYPES];
+
+	/* number of /dev/rfkill opens avoided by sharing fd */
+	guint fds_saved;
+
+	/* queued requests, per type */
+	gboolean pending[NUM_RFKILL_TYPES];
+	gboolean block[NUM_RFKILL_TYPES];
+	GSList *tasks[NUM_RFKILL_TYPES];
+};
+
+typedef GObjectClass UrfKernelBatchClass;
+
+G_DEFINE_TYPE (UrfKernelBatch, urf_kernel_batch, G_TYPE_OBJECT)
+
+/**
+ * complete_tasks:
+ **/
+static void
+complete_tasks (GSList   *tasks,
+		gint      type,
+		gboolean  success)
+{
+	GSList *item;
+
+	/* tasks were queued with g_slist_prepend */
+	tasks = g_slist_reverse (tasks);
+
+	for (item = tasks; item; item = item->next) {
+		GTask *task = G_TASK (item->data);
+
+		if (success)
+			g_task_return_pointer (task, NULL, NULL);
+		else
+			g_task_return_new_error (task,
+						 URF_DAEMON_ERROR, 0,
+						 "set_soft failed: %s",
+						 type_to_string (type));
+	}
+
+	g_slist_free (tasks);
+}
+
+/**
+ * write_change_all:
+ **/
+static gboolean
+write_change_all (UrfKernelBatch *batch,
+		  gint            type,
+		  gboolean        block)
+{
+	struct rfkill_event event;
+	ssize_t len;
+
+	memset (&event, 0, sizeof(event));
+	event.op = RFKILL_OP_CHANGE_ALL;
+	event.type = type;
+	event.soft = block;
+
+	g_message ("%s: Setting %s to %s",
+		   __func__,
+		   type_to_string (type),
+		   block ? "blocked" : "unblocked");
+
+	len = write (batch->fd, &event, sizeof(event));
+	if (len < 0) {
+		g_warning ("Failed to change RFKILL state: %s",
+			   g_strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * flush_type:
+ **/
+static void
+flush_type (UrfKernelBatch *batch,
+	    gint            type)
+{
+	GSList *tasks;
+	gboolean success;
+
+	if (!batch->pending[type])
+		return;
+
+	success = write_change_all (batch, type, batch->block[type]);
+
+	tasks = batch->tasks[type];
+	batch->tasks[type] = NULL;
+	batch->pending[type] = FALSE;
+
+	complete_tasks (tasks, type, success);
+}
+
+/**
+ * can_write_type_all:
+ *
+ * Return value: #TRUE if every type that has kernel devices has a
+ *               request queued for the same state, and at least two
+ *               writes would be saved by a single RFKILL_TYPE_ALL write.
+ **/
+static gboolean
+can_write_type_all (UrfKernelBatch *batch,
+		    gboolean       *block)
+{
+	guint count = 0;
+	gint i;
+
+	if (!batch->allow_type_all)
+		return FALSE;
+
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		if (batch->registered[i] == 0 && !batch->pending[i])
+			continue;
+
+		if (!batch->pending[i])
+			return FALSE;
+
+		if (count > 0 && batch->block[i] != *block)
+			return FALSE;
+
+		*block = batch->block[i];
+		count++;
+	}
+
+	return count > 1;
+}
+
+/**
+ * urf_kernel_batch_flush:
+ *
+ * Writes out every queued request now and completes the waiting tasks.
+ **/
+void
+urf_kernel_batch_flush (UrfKernelBatch *batch)
+{
+	gboolean block = FALSE;
+	gboolean success;
+	GSList *tasks;
+	gint i;
+
+	g_return_if_fail (URF_IS_KERNEL_BATCH (batch));
+
+	if (batch->idle_id > 0) {
+		g_source_remove (batch->idle_id);
+		batch->idle_id = 0;
+	}
+
+	if (can_write_type_all (batch, &block)) {
+		success = write_change_all (batch, RFKILL_TYPE_ALL, block);
+
+		for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+			if (!batch->pending[i])
+				continue;
+
+			tasks = batch->tasks[i];
+			batch->tasks[i] = NULL;
+			batch->pending[i] = FALSE;
+
+			complete_tasks (tasks, i, success);
+		}
+		return;
+	}
+
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++)
+		flush_type (batch, i);
+}
+
+/**
+ * flush_idle_cb:
+ **/
+static gboolean
+flush_idle_cb (gpointer user_data)
+{
+	UrfKernelBatch *batch = URF_KERNEL_BATCH (user_data);
+
+	batch->idle_id = 0;
+	urf_kernel_batch_flush (batch);
+
+	return FALSE;
+}
+
+/**
+ * urf_kernel_batch_queue:
+ *
+ * Queues a soft block of every kernel device of @type. @task, if not
+ * %NULL, is completed once the request has been written.
+ **/
+void
+urf_kernel_batch_queue (UrfKernelBatch *batch,
+			gint            type,
+			gboolean        block,
+			GTask          *task)
+{
+	g_return_if_fail (URF_IS_KERNEL_BATCH (batch));
+	g_return_if_fail (type > RFKILL_TYPE_ALL && type < NUM_RFKILL_TYPES);
+
+	/* A request for the other state must not overtake the one
+	 * already queued, so write that one out first */
+	if (batch->pending[type] && batch->block[type] != block)
+		flush_type (batch, type);
+
+	batch->pending[type] = TRUE;
+	batch->block[type] = block;
+	if (task)
+		batch->tasks[type] = g_slist_prepend (batch->tasks[type], task);
+
+	if (batch->idle_id == 0)
+		batch->idle_id = g_idle_add (flush_idle_cb, batch);
+}
+
+/**
+ * urf_kernel_batch_register_type:
+ **/
+void
+urf_kernel_batch_register_type (UrfKernelBatch *batch,
+				gint            type)
+{
+	g_return_if_fail (URF_IS_KERNEL_BATCH (batch));
+	g_return_if_fail (type > RFKILL_TYPE_ALL && type < NUM_RFKILL_TYPES);
+
+	batch->registered[type]++;
+	batch->fds_saved++;
+
+	g_debug ("%s: %s device added, %u rfkill fds saved", __func__,
+		 type_to_string (type), batch->fds_saved);
+}
+
+/**
+ * urf_kernel_batch_unregister_type:
+ **/
+void
+urf_kernel_batch_unregister_type (UrfKernelBatch *batch,
+				  gint            type)
+{
+	g_return_if_fail (URF_IS_KERNEL_BATCH (batch));
+	g_return_if_fail (type > RFKILL_TYPE_ALL && type < NUM_RFKILL_TYPES);
+	g_return_if_fail (batch->registered[type] > 0);
+
+	batch->registered[type]--;
+}
+
+/**
+ * urf_kernel_batch_get_fds_saved:
+ *
+ * Return value: the number of kernel devices that used the shared
+ *               descriptor instead of opening /dev/rfkill
+ **/
+guint
+urf_kernel_batch_get_fds_saved (UrfKernelBatch *batch)
+{
+	g_return_val_if_fail (URF_IS_KERNEL_BATCH (batch), 0);
+
+	return batch->fds_saved;
+}
+
+static void
+urf_kernel_batch_dispose (GObject *object)
+{
+	UrfKernelBatch *batch;
+
+	g_return_if_fail (URF_IS_KERNEL_BATCH (object));
+	batch = URF_KERNEL_BATCH (object);
+
+	/* don't leave any caller waiting */
+	urf_kernel_batch_flush (batch);
+
+	G_OBJECT_CLASS (urf_kernel_batch_parent_class)->dispose (object);
+}
+
+static void
+urf_kernel_batch_class_init (UrfKernelBatchClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->dispose = urf_kernel_batch_dispose;
+}
+
+static void
+urf_kernel_batch_init (UrfKernelBatch *batch)
+{
+	batch->fd = -1;
+}
+
+/**
+ * urf_kernel_batch_new:
+ *
+ * @fd: an open /dev/rfkill descriptor, owned by the caller
+ * @allow_type_all: whether requests may be merged into a single
+ *                  RFKILL_TYPE_ALL write. This must be %FALSE if some
+ *                  kernel rfkill devices are not managed through the batch.
+ **/
+UrfKernelBatch *
+urf_kernel_batch_new (int      fd,
+		      gboolean allow_type_all)
+{
+	UrfKernelBatch *batch;
+
+	batch = g_object_new (URF_TYPE_KERNEL_BATCH, NULL);
+	batch->fd = fd;
+	batch->allow_type_all = allow_type_all;
+
+	return batch;
+}
+
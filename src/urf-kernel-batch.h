@@ -0,0 +1,54 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Canonical Ltd.
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __URF_KERNEL_BATCH_H
+#define __URF_KERNEL_BATCH_H
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define URF_TYPE_KERNEL_BATCH (urf_kernel_batch_get_type ())
+#define URF_KERNEL_BATCH(o) (G_TYPE_CHECK_INSTANCE_CAST ((o), URF_TYPE_KERNEL_BATCH, UrfKernelBatch))
+#define URF_IS_KERNEL_BATCH(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), URF_TYPE_KERNEL_BATCH))
+
+typedef struct _UrfKernelBatch UrfKernelBatch;
+
+GType urf_kernel_batch_get_type (void);
+
+UrfKernelBatch* urf_kernel_batch_new (int fd,
+                                      gboolean allow_type_all);
+void urf_kernel_batch_register_type (UrfKernelBatch *batch,
+                                     gint type);
+void urf_kernel_batch_unregister_type (UrfKernelBatch *batch,
+                                       gint type);
+void urf_kernel_batch_queue (UrfKernelBatch *batch,
+                             gint type,
+                             gboolean block,
+                             GTask *task);
+void urf_kernel_batch_flush (UrfKernelBatch *batch);
+guint urf_kernel_batch_get_fds_saved (UrfKernelBatch *batch);
+
+G_END_DECLS
+
+#endif /* __URF_KERNEL_BATCH_H */
+
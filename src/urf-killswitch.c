@@ -29,6 +29,7 @@
 
 #include "urf-killswitch.h"
 #include "urf-device.h"
+#include "urf-signal-scheduler.h"
 
 #define BASE_OBJECT_PATH "/org/freedesktop/URfkill/"
 #define URF_KILLSWITCH_INTERFACE "org.freedesktop.URfkill.Killswitch"
@@ -48,17 +49,33 @@ enum
 	PROP_LAST
 };
 
+/* number of devices in each state, indexed by state + 1 */
+#define NUM_STATES (KILLSWITCH_STATE_HARD_BLOCKED + 2)
+
 struct UrfKillswitchPrivate
 {
 	GList		 *devices;
+	GHashTable	 *device_states; /* UrfDevice -> last known state + 1 */
+	guint		  platform_count[NUM_STATES];
+	guint		  non_platform_count[NUM_STATES];
 	enum rfkill_type  type;
 	KillswitchState   state;
+	KillswitchState   emitted_state;
 	char		 *object_path;
 	GDBusConnection	 *connection;
 	GDBusNodeInfo	 *introspection_data;
-	GTask            *set_block_task;
-	GTask            *pending_device_task;
-	gboolean          pending_block;
+};
+
+/*
+ * Book-keeping for one urf_killswitch_set_software_blocked() call. Every
+ * device gets its own GTask and the aggregate task is completed once the
+ * last of them has reported back.
+ */
+struct block_data {
+	GTask		*task;
+	guint		 pending;
+	GError		*error;
+	GString		*failed;
 };
 
 G_DEFINE_TYPE (UrfKillswitch, urf_killswitch, G_TYPE_OBJECT)
@@ -111,45 +128,75 @@ emit_properites_changed (UrfKillswitch *killswitch)
 }
 
 /**
- * urf_killswitch_state_refresh:
+ * urf_killswitch_emit_state:
+ *
+ * Called by the signal scheduler once per idle cycle.
  **/
 static void
-urf_killswitch_state_refresh (UrfKillswitch *killswitch)
+urf_killswitch_emit_state (GObject *object)
 {
+	UrfKillswitch *killswitch = URF_KILLSWITCH (object);
 	UrfKillswitchPrivate *priv = killswitch->priv;
-	KillswitchState platform;
-	KillswitchState new_state;
-	gboolean platform_checked = FALSE;
-	UrfDevice *device;
-	GList *iter;
 	GError *error = NULL;
 
-	if (priv->devices == NULL) {
-		priv->state = KILLSWITCH_STATE_NO_ADAPTER;
+	/* the state may have gone back to where it was */
+	if (priv->emitted_state == priv->state)
 		return;
+
+	priv->emitted_state = priv->state;
+
+	emit_properites_changed (killswitch);
+	g_debug("Emitting StateChanged on killswitch %s", priv->object_path);
+	g_dbus_connection_emit_signal (priv->connection,
+	                               NULL,
+	                               priv->object_path,
+	                               URF_KILLSWITCH_INTERFACE,
+	                               "StateChanged",
+	                               NULL,
+	                               &error);
+	if (error) {
+		g_warning ("Failed to emit StateChanged: %s",
+		           error->message);
+		g_error_free (error);
 	}
+}
 
-	platform = KILLSWITCH_STATE_NO_ADAPTER;
-	new_state = KILLSWITCH_STATE_NO_ADAPTER;
-
-	for (iter = priv->devices; iter; iter = iter->next) {
-		KillswitchState state;
-		device = (UrfDevice *)iter->data;
-		state = urf_device_get_state (device);
-
-		if (urf_device_is_platform (device) == TRUE) {
-			/* Update the state of platform switch */
-			platform_checked = TRUE;
-			if (state > platform)
-				platform = state;
-		} else {
-			/* Update the state of non-platform switch */
-			if (state > new_state)
-				new_state = state;
-		}
+/**
+ * highest_state:
+ *
+ * Return value: the most restrictive state with a non-zero count
+ **/
+static KillswitchState
+highest_state (const guint *count)
+{
+	KillswitchState state;
+
+	for (state = KILLSWITCH_STATE_HARD_BLOCKED;
+	     state > KILLSWITCH_STATE_NO_ADAPTER;
+	     state--) {
+		if (count[state + 1] > 0)
+			return state;
 	}
 
-	if (platform_checked)
+	return KILLSWITCH_STATE_NO_ADAPTER;
+}
+
+/**
+ * urf_killswitch_state_refresh:
+ *
+ * Recomputes the aggregate state from the per-state device counters.
+ **/
+static void
+urf_killswitch_state_refresh (UrfKillswitch *killswitch)
+{
+	UrfKillswitchPrivate *priv = killswitch->priv;
+	KillswitchState platform;
+	KillswitchState new_state;
+
+	platform = highest_state (priv->platform_count);
+	new_state = highest_state (priv->non_platform_count);
+
+	if (platform != KILLSWITCH_STATE_NO_ADAPTER)
 		new_state = aggregate_states (platform, new_state);
 
 	g_debug ("killswitch %s state: %s new_state: %s",
@@ -157,30 +204,43 @@ urf_killswitch_state_refresh (UrfKillswitch *killswitch)
 		state_to_string (priv->state),
 		state_to_string (new_state));
 
-	/* emit a signal for change */
+	/* the signals are emitted once the burst of changes is over */
 	if (priv->state != new_state) {
 		priv->state = new_state;
-		emit_properites_changed (killswitch);
-		g_debug("Emitting StateChanged on killswitch %s", priv->object_path);
-		g_dbus_connection_emit_signal (priv->connection,
-		                               NULL,
-		                               priv->object_path,
-		                               URF_KILLSWITCH_INTERFACE,
-		                               "StateChanged",
-		                               NULL,
-		                               &error);
-		if (error) {
-			g_warning ("Failed to emit StateChanged: %s",
-			           error->message);
-			g_error_free (error);
-		}
+		urf_signal_scheduler_queue (G_OBJECT (killswitch),
+					    urf_killswitch_emit_state);
 	}
 }
 
+/**
+ * urf_killswitch_count_device:
+ *
+ * Adds @delta to the counter of the state @device is in. Whether a
+ * device is a platform one does not change over its lifetime.
+ **/
+static void
+urf_killswitch_count_device (UrfKillswitch   *killswitch,
+			     UrfDevice       *device,
+			     KillswitchState  state,
+			     gint             delta)
+{
+	UrfKillswitchPrivate *priv = killswitch->priv;
+	guint *count;
+
+	g_return_if_fail (state >= KILLSWITCH_STATE_NO_ADAPTER &&
+			  state <= KILLSWITCH_STATE_HARD_BLOCKED);
+
+	if (urf_device_is_platform (device))
+		count = priv->platform_count;
+	else
+		count = priv->non_platform_count;
+
+	count[state + 1] += delta;
+}
+
 KillswitchState
 urf_killswitch_get_state (UrfKillswitch *killswitch)
 {
-	urf_killswitch_state_refresh (killswitch);
 	return killswitch->priv->state;
 }
 
@@ -188,7 +248,21 @@ static void
 device_changed_cb (UrfDevice     *device,
 		   UrfKillswitch *killswitch)
 {
-	g_message("device_changed_cb: %s", urf_device_get_name(device));
+	UrfKillswitchPrivate *priv = killswitch->priv;
+	KillswitchState old_state;
+	KillswitchState state;
+
+	g_message("device_changed_cb: %s", urf_device_get_object_path(device));
+
+	old_state = GPOINTER_TO_INT (g_hash_table_lookup (priv->device_states, device)) - 1;
+	state = urf_device_get_state (device);
+	if (state == old_state)
+		return;
+
+	urf_killswitch_count_device (killswitch, device, old_state, -1);
+	urf_killswitch_count_device (killswitch, device, state, 1);
+	g_hash_table_insert (priv->device_states, device, GINT_TO_POINTER (state + 1));
+
 	urf_killswitch_state_refresh (killswitch);
 }
 
@@ -200,9 +274,10 @@ urf_killswitch_add_device (UrfKillswitch *killswitch,
 			   UrfDevice     *device)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
+	KillswitchState state;
 
 	if (urf_device_get_device_type (device) != priv->type ||
-	    g_list_find (priv->devices, (gconstpointer)device) != NULL)
+	    g_hash_table_contains (priv->device_states, device))
 		return;
 
 	priv->devices = g_list_prepend (priv->devices,
@@ -210,6 +285,10 @@ urf_killswitch_add_device (UrfKillswitch *killswitch,
 	g_signal_connect (G_OBJECT (device), "state-changed",
 			  G_CALLBACK (device_changed_cb), killswitch);
 
+	state = urf_device_get_state (device);
+	urf_killswitch_count_device (killswitch, device, state, 1);
+	g_hash_table_insert (priv->device_states, device, GINT_TO_POINTER (state + 1));
+
 	urf_killswitch_state_refresh (killswitch);
 }
 
@@ -221,17 +300,52 @@ urf_killswitch_del_device (UrfKillswitch *killswitch,
 			   UrfDevice     *device)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
+	KillswitchState state;
 
 	if (urf_device_get_device_type (device) != priv->type ||
-	    g_list_find (priv->devices, (gconstpointer)device) == NULL)
+	    !g_hash_table_contains (priv->device_states, device))
 		return;
 
+	g_signal_handlers_disconnect_by_func (device, device_changed_cb, killswitch);
+
+	state = GPOINTER_TO_INT (g_hash_table_lookup (priv->device_states, device)) - 1;
+	urf_killswitch_count_device (killswitch, device, state, -1);
+	g_hash_table_remove (priv->device_states, device);
+
 	priv->devices = g_list_remove (priv->devices, (gpointer)device);
 	g_object_unref (device);
 
 	urf_killswitch_state_refresh (killswitch);
 }
 
+/**
+ * block_data_complete:
+ **/
+static void
+block_data_complete (struct block_data *data)
+{
+	if (data->error != NULL) {
+		g_warning ("set_block failed: %s", data->failed->str);
+
+		if (data->task)
+			g_task_return_new_error (data->task,
+						 data->error->domain,
+						 data->error->code,
+						 "set_block failed: %s",
+						 data->failed->str);
+
+		g_error_free (data->error);
+	} else {
+		g_message ("%s: all done", __func__);
+
+		if (data->task)
+			g_task_return_pointer (data->task, NULL, NULL);
+	}
+
+	g_string_free (data->failed, TRUE);
+	g_free (data);
+}
+
 /**
  * urf_killswitch_soft_block_cb:
  **/
@@ -240,67 +354,39 @@ urf_killswitch_soft_block_cb (GObject *source,
 			      GAsyncResult *res,
 			      gpointer user_data)
 {
-	UrfKillswitch  *killswitch;
-	UrfKillswitchPrivate *priv;
-	GError            *error = NULL;
-	GList *dev = user_data;
+	struct block_data *data = user_data;
+	UrfDevice *device;
+	GError *error = NULL;
 
 	g_assert (URF_IS_KILLSWITCH (source));
-	killswitch = URF_KILLSWITCH (source);
-
-	priv = killswitch->priv;
+	g_assert (g_task_is_valid (res, source));
 
-	g_assert (URF_IS_DEVICE(dev->data));
+	device = URF_DEVICE (g_task_get_task_data (G_TASK (res)));
 
-	g_assert (g_task_is_valid(res, source));
-	g_assert (G_TASK(res) == G_TASK(priv->pending_device_task));
-	priv->pending_device_task = NULL;
-
-	g_task_propagate_pointer(G_TASK (res), &error);
-	g_object_unref (G_TASK (res));
+	g_task_propagate_pointer (G_TASK (res), &error);
 
 	if (error != NULL) {
-		g_warning ("%s *error != NULL (Failed)", __func__);
-
-		if (priv->set_block_task) {
-			g_debug ("%s: returning new error: %s", __func__, error->message);
-
-			g_task_return_new_error(priv->set_block_task,
-						error->domain, error->code,
-						"set_block failed: %s",
-						urf_device_get_object_path (URF_DEVICE (dev->data)));
-
-			priv->set_block_task = NULL;
-		}
-
-		g_error_free (error);
-		error = NULL;
-
-	} else if (dev->next == NULL) {
-		g_message ("%s: all done", __func__);
-
-		if (priv->set_block_task) {
-			g_debug ("%s: firing set_block_task OK", __func__);
-
-			g_task_return_pointer (priv->set_block_task, NULL, NULL);
-			priv->set_block_task = NULL;
-		}
-	} else {
-		dev = dev->next;
-
-		g_message ("%s: Setting device %s to %s",
-			 __func__,
-			 urf_device_get_object_path (URF_DEVICE (dev->data)),
-			 priv->pending_block ? "blocked" : "unblocked");
+		g_warning ("%s: %s failed: %s", __func__,
+			   urf_device_get_object_path (device),
+			   error->message);
+
+		/* Report every failing device, but keep the first error */
+		if (data->failed->len > 0)
+			g_string_append (data->failed, ", ");
+		g_string_append (data->failed,
+				 urf_device_get_object_path (device));
+
+		if (data->error == NULL)
+			data->error = error;
+		else
+			g_error_free (error);
+	}
 
-		priv->pending_device_task = g_task_new(killswitch,
-						       NULL,
-						       urf_killswitch_soft_block_cb,
-						       dev);
+	g_object_unref (G_TASK (res));
 
-		urf_device_set_software_blocked (URF_DEVICE (dev->data), priv->pending_block,
-						 priv->pending_device_task);
-	}
+	g_assert (data->pending > 0);
+	if (--data->pending == 0)
+		block_data_complete (data);
 }
 
 /**
@@ -312,37 +398,53 @@ urf_killswitch_set_software_blocked (UrfKillswitch *killswitch,
 				     GTask *task)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
-	GList *dev = priv->devices;
+	struct block_data *data;
+	GList *devices;
+	GList *dev;
+
+	if (priv->devices == NULL) {
+		g_debug ("%s: no devices for %s", __func__, type_to_string (priv->type));
+
+		if (task) {
+			g_message ("%s: calling task_return_pointer (no error)", __func__);
+			g_task_return_pointer (task, NULL, NULL);
+		}
+		return;
+	}
 
 	/*
-	 * As each device_set_software_blocked () operation is asynchronous,
-	 * The sequence is started with the first device, and handle any
-	 * subsequent devices in the callback.
+	 * Every device_set_software_blocked () operation is asynchronous,
+	 * so issue them all at once and complete the task when the last
+	 * one has finished. The device list is copied as a device may be
+	 * removed while the operations are in flight.
 	 */
+	devices = g_list_copy (priv->devices);
 
-	if (dev) {
-		priv->set_block_task = task;
-		priv->pending_block = block;
+	data = g_new0 (struct block_data, 1);
+	data->task = task;
+	data->pending = g_list_length (devices);
+	data->failed = g_string_new (NULL);
+
+	for (dev = devices; dev; dev = dev->next) {
+		UrfDevice *device = URF_DEVICE (dev->data);
+		GTask *device_task;
 
 		g_debug ("Setting device %s to %s",
-			 urf_device_get_object_path (URF_DEVICE (dev->data)),
+			 urf_device_get_object_path (device),
 			 block ? "block" : "unblock");
 
-		priv->pending_device_task = g_task_new(killswitch,
-						       NULL,
-						       urf_killswitch_soft_block_cb,
-						       dev);
-
-		urf_device_set_software_blocked (URF_DEVICE (dev->data), block,
-						 priv->pending_device_task);
-	} else {
-		g_debug ("%s: no devices for %s", __func__, type_to_string (priv->type));
+		device_task = g_task_new (killswitch,
+					  NULL,
+					  urf_killswitch_soft_block_cb,
+					  data);
+		g_task_set_task_data (device_task,
+				      g_object_ref (device),
+				      g_object_unref);
 
-		if (task) {
-			g_message ("%s: calling task_return_pointer (no error)", __func__);
-			g_task_return_pointer (task, NULL, NULL);
-		}
+		urf_device_set_software_blocked (device, block, device_task);
 	}
+
+	g_list_free (devices);
 }
 
 /**
@@ -365,11 +467,22 @@ urf_killswitch_dispose (GObject *object)
 	}
 
 	if (priv->devices) {
-		g_list_foreach (priv->devices, (GFunc) g_object_unref, NULL);
-		g_list_free (priv->devices);
+		GList *iter;
+
+		for (iter = priv->devices; iter; iter = iter->next)
+			g_signal_handlers_disconnect_by_func (iter->data,
+							      device_changed_cb,
+							      killswitch);
+
+		g_list_free_full (priv->devices, g_object_unref);
 		priv->devices = NULL;
 	}
 
+	if (priv->device_states) {
+		g_hash_table_destroy (priv->device_states);
+		priv->device_states = NULL;
+	}
+
 	G_OBJECT_CLASS (urf_killswitch_parent_class)->dispose (object);
 }
 
@@ -440,8 +553,10 @@ urf_killswitch_init (UrfKillswitch *killswitch)
 {
 	killswitch->priv = URF_KILLSWITCH_GET_PRIVATE (killswitch);
 	killswitch->priv->devices = NULL;
+	killswitch->priv->device_states = g_hash_table_new (g_direct_hash, g_direct_equal);
 	killswitch->priv->object_path = NULL;
 	killswitch->priv->state = KILLSWITCH_STATE_NO_ADAPTER;
+	killswitch->priv->emitted_state = KILLSWITCH_STATE_NO_ADAPTER;
 }
 
 static GVariant *
@@ -506,6 +621,45 @@ urf_killswitch_register_switch (UrfKillswitch *killswitch)
 	return TRUE;
 }
 
+/**
+ * urf_killswitch_get_object_path:
+ **/
+const char *
+urf_killswitch_get_object_path (UrfKillswitch *killswitch)
+{
+	g_return_val_if_fail (URF_IS_KILLSWITCH (killswitch), NULL);
+
+	return killswitch->priv->object_path;
+}
+
+/**
+ * urf_killswitch_get_managed_interfaces:
+ *
+ * Return value: a floating a{sa{sv}} #GVariant with the interface of
+ *               @killswitch and its properties
+ **/
+GVariant *
+urf_killswitch_get_managed_interfaces (UrfKillswitch *killswitch)
+{
+	UrfKillswitchPrivate *priv = killswitch->priv;
+	GDBusInterfaceInfo *info;
+	GVariantBuilder builder;
+
+	g_return_val_if_fail (URF_IS_KILLSWITCH (killswitch), NULL);
+
+	info = priv->introspection_data->interfaces[0];
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+	g_variant_builder_add (&builder, "{s@a{sv}}", info->name,
+			       get_interface_properties (priv->connection,
+							 priv->object_path,
+							 info,
+							 &interface_vtable,
+							 killswitch));
+
+	return g_variant_builder_end (&builder);
+}
+
 /**
  * urf_killswitch_new:
  **/
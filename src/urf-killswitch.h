@@ -60,6 +60,8 @@ void			 urf_killswitch_add_device		(UrfKillswitch		*killswitch,
 void			 urf_killswitch_del_device		(UrfKillswitch		*killswitch,
 								 UrfDevice		*device);
 KillswitchState		 urf_killswitch_get_state		(UrfKillswitch		*killswitch);
+const char		*urf_killswitch_get_object_path		(UrfKillswitch		*killswitch);
+GVariant		*urf_killswitch_get_managed_interfaces	(UrfKillswitch		*killswitch);
 void      		 urf_killswitch_set_software_blocked	(UrfKillswitch		*killswitch,
 								 gboolean		 block,
 								 GTask                  *task);
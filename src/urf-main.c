@@ -276,6 +276,9 @@ main (gint argc, gchar **argv)
 	g_main_loop_run (loop);
 	retval = 0;
 	g_bus_unown_name (owner_id);
+
+	/* write out delayed persistence changes, e.g. on SIGTERM */
+	urf_config_flush (config);
 out:
 	if (daemon != NULL)
 		g_object_unref (daemon);
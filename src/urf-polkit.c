@@ -35,79 +35,443 @@
 
 #define URF_POLKIT_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), URF_TYPE_POLKIT, UrfPolkitPrivate))
 
+/* Authorizations are remembered for a short while and for a bounded
+ * number of (sender, action) pairs */
+#define URF_POLKIT_CACHE_SIZE		64
+#define URF_POLKIT_CACHE_TIMEOUT	60 /* seconds */
+
 struct UrfPolkitPrivate
 {
 	PolkitAuthority	*authority;
+	gboolean	 authority_pending;
+	GList		*pending_checks; /* GTask waiting for the authority */
+	GHashTable	*cache;		 /* "sender\naction" -> expiry time */
+	GQueue		*cache_order;	 /* keys, oldest first */
+	guint		 cache_generation;
+	guint		 cache_hits;
+	guint		 cache_misses;
+	GDBusConnection	*connection;
+	guint		 name_owner_changed_id;
 };
 
+typedef struct {
+	PolkitSubject	*subject;
+	GDBusConnection	*connection;
+	char		*sender;
+	char		*action_id;
+	gboolean	 interactive;
+	guint		 generation;
+} AuthCheck;
+
 G_DEFINE_TYPE (UrfPolkit, urf_polkit, G_TYPE_OBJECT)
 static gpointer urf_polkit_object = NULL;
 
+static void urf_polkit_run_check (UrfPolkit *polkit, GTask *task);
+
 /**
- * urf_polkit_get_subject:
+ * auth_check_free:
  **/
-PolkitSubject *
-urf_polkit_get_subject (UrfPolkit             *polkit,
-                        GDBusMethodInvocation *invocation)
+static void
+auth_check_free (AuthCheck *check)
 {
-	const gchar *sender;
+	g_object_unref (check->subject);
+	g_object_unref (check->connection);
+	g_free (check->sender);
+	g_free (check->action_id);
+	g_slice_free (AuthCheck, check);
+}
+
+/**
+ * urf_polkit_cache_key:
+ **/
+static char *
+urf_polkit_cache_key (const char *sender,
+		      const char *action_id)
+{
+	return g_strdup_printf ("%s\n%s", sender, action_id);
+}
+
+/**
+ * urf_polkit_cache_remove:
+ **/
+static void
+urf_polkit_cache_remove (UrfPolkit  *polkit,
+			 const char *key)
+{
+	UrfPolkitPrivate *priv = polkit->priv;
+	GList *link;
+
+	link = g_queue_find_custom (priv->cache_order, key, (GCompareFunc) g_strcmp0);
+	if (link == NULL)
+		return;
+
+	g_queue_delete_link (priv->cache_order, link);
+	/* frees the key */
+	g_hash_table_remove (priv->cache, key);
+}
+
+/**
+ * urf_polkit_cache_clear:
+ **/
+static void
+urf_polkit_cache_clear (UrfPolkit *polkit)
+{
+	UrfPolkitPrivate *priv = polkit->priv;
+
+	g_queue_clear (priv->cache_order);
+	g_hash_table_remove_all (priv->cache);
+
+	/* Checks still in flight must not refill the cache */
+	priv->cache_generation++;
+}
+
+/**
+ * urf_polkit_cache_lookup:
+ **/
+static gboolean
+urf_polkit_cache_lookup (UrfPolkit  *polkit,
+			 const char *sender,
+			 const char *action_id)
+{
+	UrfPolkitPrivate *priv = polkit->priv;
+	gint64 *expiry;
+	char *key;
+	gboolean ret = FALSE;
+
+	key = urf_polkit_cache_key (sender, action_id);
+	expiry = g_hash_table_lookup (priv->cache, key);
+	if (expiry != NULL) {
+		if (g_get_monotonic_time () < *expiry)
+			ret = TRUE;
+		else
+			urf_polkit_cache_remove (polkit, key);
+	}
+	g_free (key);
+
+	if (ret)
+		priv->cache_hits++;
+	else
+		priv->cache_misses++;
+
+	g_debug ("Authorization cache %s for %s (%s): %u hits, %u misses",
+		 ret ? "hit" : "miss", sender, action_id,
+		 priv->cache_hits, priv->cache_misses);
+
+	return ret;
+}
+
+/**
+ * urf_polkit_name_owner_changed_cb:
+ **/
+static void
+urf_polkit_name_owner_changed_cb (GDBusConnection *connection,
+				  const gchar     *sender_name,
+				  const gchar     *object_path,
+				  const gchar     *interface_name,
+				  const gchar     *signal_name,
+				  GVariant        *parameters,
+				  gpointer         user_data)
+{
+	UrfPolkit *polkit = URF_POLKIT (user_data);
+	UrfPolkitPrivate *priv = polkit->priv;
+	const char *name;
+	const char *old_owner;
+	const char *new_owner;
+	char *prefix;
+	GList *item;
+	GList *next;
+
+	g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+
+	/* Only unique names leaving the bus matter */
+	if (name[0] != ':' || new_owner[0] != '\0')
+		return;
+
+	prefix = g_strdup_printf ("%s\n", name);
+	for (item = priv->cache_order->head; item; item = next) {
+		char *key = item->data;
+
+		next = item->next;
+		if (!g_str_has_prefix (key, prefix))
+			continue;
+		g_queue_delete_link (priv->cache_order, item);
+		g_hash_table_remove (priv->cache, key);
+	}
+	g_free (prefix);
+}
+
+/**
+ * urf_polkit_cache_insert:
+ **/
+static void
+urf_polkit_cache_insert (UrfPolkit       *polkit,
+			 GDBusConnection *connection,
+			 const char      *sender,
+			 const char      *action_id)
+{
+	UrfPolkitPrivate *priv = polkit->priv;
+	gint64 *expiry;
+	char *key;
+
+	/* Forget the callers once they leave the bus */
+	if (priv->connection == NULL) {
+		priv->connection = g_object_ref (connection);
+		priv->name_owner_changed_id =
+			g_dbus_connection_signal_subscribe (connection,
+							    "org.freedesktop.DBus",
+							    "org.freedesktop.DBus",
+							    "NameOwnerChanged",
+							    "/org/freedesktop/DBus",
+							    NULL,
+							    G_DBUS_SIGNAL_FLAGS_NONE,
+							    urf_polkit_name_owner_changed_cb,
+							    polkit, NULL);
+	}
+
+	key = urf_polkit_cache_key (sender, action_id);
+	urf_polkit_cache_remove (polkit, key);
+
+	while (g_queue_get_length (priv->cache_order) >= URF_POLKIT_CACHE_SIZE) {
+		char *oldest = g_queue_pop_head (priv->cache_order);
+		g_hash_table_remove (priv->cache, oldest);
+	}
+
+	expiry = g_new (gint64, 1);
+	*expiry = g_get_monotonic_time () + URF_POLKIT_CACHE_TIMEOUT * G_USEC_PER_SEC;
+	g_hash_table_insert (priv->cache, key, expiry);
+	g_queue_push_tail (priv->cache_order, key);
+}
+
+/**
+ * urf_polkit_authority_changed_cb:
+ **/
+static void
+urf_polkit_authority_changed_cb (PolkitAuthority *authority,
+				 gpointer         user_data)
+{
+	UrfPolkit *polkit = URF_POLKIT (user_data);
+
+	g_debug ("polkit authority changed, dropping cached authorizations");
+	urf_polkit_cache_clear (polkit);
+}
+
+/**
+ * urf_polkit_check_auth_cb:
+ **/
+static void
+urf_polkit_check_auth_cb (GObject      *source,
+			  GAsyncResult *res,
+			  gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	UrfPolkit *polkit = URF_POLKIT (g_task_get_source_object (task));
+	AuthCheck *check = g_task_get_task_data (task);
+	PolkitAuthorizationResult *result;
+	GError *error = NULL;
+
+	result = polkit_authority_check_authorization_finish (POLKIT_AUTHORITY (source),
+							      res, &error);
+	if (result == NULL) {
+		g_task_return_new_error (task,
+		                         URF_DAEMON_ERROR,
+		                         URF_DAEMON_ERROR_GENERAL,
+		                         "failed to check authorisation: %s",
+		                         error->message);
+		g_error_free (error);
+	} else if (polkit_authorization_result_get_is_authorized (result)) {
+		/* A grant that needed the user to authenticate is only
+		 * reused if polkit itself keeps it */
+		if (check->generation == polkit->priv->cache_generation &&
+		    (!check->interactive ||
+		     polkit_authorization_result_get_retains_authorization (result)))
+			urf_polkit_cache_insert (polkit,
+						 check->connection,
+						 check->sender,
+						 check->action_id);
+		g_task_return_boolean (task, TRUE);
+	} else if (!check->interactive &&
+		   polkit_authorization_result_get_is_challenge (result)) {
+		/* Ask again, this time allowing an authentication dialog */
+		g_object_unref (result);
+		check->interactive = TRUE;
+		urf_polkit_run_check (polkit, task);
+		return;
+	} else {
+		g_task_return_new_error (task,
+		                         URF_DAEMON_ERROR,
+		                         URF_DAEMON_ERROR_GENERAL,
+		                         "not authorized");
+	}
+
+	if (result != NULL)
+		g_object_unref (result);
+	g_object_unref (task);
+}
+
+/**
+ * urf_polkit_run_check:
+ **/
+static void
+urf_polkit_run_check (UrfPolkit *polkit,
+		      GTask     *task)
+{
+	AuthCheck *check = g_task_get_task_data (task);
+
+	if (polkit->priv->authority == NULL) {
+		g_task_return_new_error (task,
+		                         URF_DAEMON_ERROR,
+		                         URF_DAEMON_ERROR_GENERAL,
+		                         "failed to check authorisation: no polkit authority");
+		g_object_unref (task);
+		return;
+	}
+
+	polkit_authority_check_authorization (polkit->priv->authority,
+					      check->subject, check->action_id, NULL,
+					      check->interactive ?
+					      POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION :
+					      POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE,
+					      g_task_get_cancellable (task),
+					      urf_polkit_check_auth_cb,
+					      task);
+}
+
+/**
+ * urf_polkit_check_auth_async:
+ *
+ * Check whether the sender of @invocation is allowed to do @action_id
+ * without blocking the main loop, e.g. while polkit shows an
+ * authentication dialog. The error of a failed check is meant to be
+ * returned to @invocation as is.
+ **/
+void
+urf_polkit_check_auth_async (UrfPolkit             *polkit,
+			     GDBusMethodInvocation *invocation,
+			     const gchar           *action_id,
+			     GCancellable          *cancellable,
+			     GAsyncReadyCallback    callback,
+			     gpointer               user_data)
+{
+	AuthCheck *check;
 	PolkitSubject *subject;
+	const gchar *sender;
+	GTask *task;
+
+	g_return_if_fail (URF_IS_POLKIT (polkit));
+
+	task = g_task_new (polkit, cancellable, callback, user_data);
 
 	sender = g_dbus_method_invocation_get_sender (invocation);
-	subject = polkit_system_bus_name_new (sender);
+	if (urf_polkit_cache_lookup (polkit, sender, action_id)) {
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
 
+	subject = polkit_system_bus_name_new (sender);
 	if (subject == NULL) {
-		g_dbus_method_invocation_return_error (invocation,
-		                                       URF_DAEMON_ERROR,
-		                                       URF_DAEMON_ERROR_GENERAL,
-		                                       "failed to get PolicyKit subject");
+		g_task_return_new_error (task,
+		                         URF_DAEMON_ERROR,
+		                         URF_DAEMON_ERROR_GENERAL,
+		                         "failed to get PolicyKit subject");
+		g_object_unref (task);
+		return;
+	}
+
+	check = g_slice_new (AuthCheck);
+	check->subject = subject;
+	check->connection = g_object_ref (g_dbus_method_invocation_get_connection (invocation));
+	check->sender = g_strdup (sender);
+	check->action_id = g_strdup (action_id);
+	/* Try without interaction first: only such grants are cached */
+	check->interactive = FALSE;
+	check->generation = polkit->priv->cache_generation;
+	g_task_set_task_data (task, check, (GDestroyNotify) auth_check_free);
+
+	/* Still waiting for the authority */
+	if (polkit->priv->authority_pending) {
+		polkit->priv->pending_checks = g_list_append (polkit->priv->pending_checks,
+							      task);
+		return;
 	}
 
-	return subject;
+	urf_polkit_run_check (polkit, task);
 }
 
 /**
- * urf_polkit_check_auth:
+ * urf_polkit_check_auth_finish:
  **/
 gboolean
-urf_polkit_check_auth (UrfPolkit             *polkit,
-		       PolkitSubject         *subject,
-		       const gchar           *action_id,
-		       GDBusMethodInvocation *invocation)
+urf_polkit_check_auth_finish (UrfPolkit     *polkit,
+			      GAsyncResult  *res,
+			      GError       **error)
 {
-	gboolean ret = FALSE;
+	g_return_val_if_fail (g_task_is_valid (res, polkit), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (res), error);
+}
+
+/**
+ * urf_polkit_get_cache_hits:
+ *
+ * Return value: the number of checks answered from the authorization
+ *               cache
+ **/
+guint
+urf_polkit_get_cache_hits (UrfPolkit *polkit)
+{
+	g_return_val_if_fail (URF_IS_POLKIT (polkit), 0);
+
+	return polkit->priv->cache_hits;
+}
+
+/**
+ * urf_polkit_get_cache_misses:
+ *
+ * Return value: the number of checks that had to ask polkit
+ **/
+guint
+urf_polkit_get_cache_misses (UrfPolkit *polkit)
+{
+	g_return_val_if_fail (URF_IS_POLKIT (polkit), 0);
+
+	return polkit->priv->cache_misses;
+}
+
+#ifdef USE_SECURITY_POLKIT_NEW
+/**
+ * urf_polkit_authority_ready_cb:
+ **/
+static void
+urf_polkit_authority_ready_cb (GObject      *source,
+			       GAsyncResult *res,
+			       gpointer      user_data)
+{
+	UrfPolkit *polkit = URF_POLKIT (user_data);
+	UrfPolkitPrivate *priv = polkit->priv;
 	GError *error = NULL;
-	PolkitAuthorizationResult *result;
+	GList *checks;
+	GList *item;
 
-	/* check auth */
-	result = polkit_authority_check_authorization_sync (polkit->priv->authority,
-							    subject, action_id, NULL,
-							    POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION,
-							    NULL, &error);
-	if (result == NULL) {
-		g_dbus_method_invocation_return_error (invocation,
-		                                       URF_DAEMON_ERROR,
-		                                       URF_DAEMON_ERROR_GENERAL,
-		                                       "failed to check authorisation: %s",
-		                                       error->message);
+	priv->authority = polkit_authority_get_finish (res, &error);
+	if (priv->authority == NULL) {
+		g_warning ("failed to get pokit authority: %s", error->message);
 		g_error_free (error);
-		goto out;
-	}
-
-	/* okay? */
-	if (polkit_authorization_result_get_is_authorized (result)) {
-		ret = TRUE;
 	} else {
-		g_dbus_method_invocation_return_error (invocation,
-		                                       URF_DAEMON_ERROR,
-		                                       URF_DAEMON_ERROR_GENERAL,
-		                                       "not authorized");
+		g_signal_connect (priv->authority, "changed",
+				  G_CALLBACK (urf_polkit_authority_changed_cb), polkit);
 	}
-out:
-	if (result != NULL)
-		g_object_unref (result);
-	return ret;
+	priv->authority_pending = FALSE;
+
+	checks = priv->pending_checks;
+	priv->pending_checks = NULL;
+	for (item = checks; item; item = item->next)
+		urf_polkit_run_check (polkit, G_TASK (item->data));
+	g_list_free (checks);
+
+	g_object_unref (polkit);
 }
+#endif
 
 /**
  * urf_polkit_finalize:
@@ -119,7 +483,19 @@ urf_polkit_finalize (GObject *object)
 	g_return_if_fail (URF_IS_POLKIT (object));
 	polkit = URF_POLKIT (object);
 
-	g_object_unref (polkit->priv->authority);
+	if (polkit->priv->authority != NULL) {
+		g_signal_handlers_disconnect_by_data (polkit->priv->authority, polkit);
+		g_object_unref (polkit->priv->authority);
+	}
+
+	if (polkit->priv->connection != NULL) {
+		g_dbus_connection_signal_unsubscribe (polkit->priv->connection,
+						      polkit->priv->name_owner_changed_id);
+		g_object_unref (polkit->priv->connection);
+	}
+
+	g_queue_free (polkit->priv->cache_order);
+	g_hash_table_destroy (polkit->priv->cache);
 
 	G_OBJECT_CLASS (urf_polkit_parent_class)->finalize (object);
 }
@@ -145,22 +521,29 @@ urf_polkit_class_init (UrfPolkitClass *klass)
 static void
 urf_polkit_init (UrfPolkit *polkit)
 {
-	GError *error = NULL;
-
 	polkit->priv = URF_POLKIT_GET_PRIVATE (polkit);
+	polkit->priv->pending_checks = NULL;
+	polkit->priv->cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+						     g_free, g_free);
+	polkit->priv->cache_order = g_queue_new ();
+	polkit->priv->cache_generation = 0;
+	polkit->priv->cache_hits = 0;
+	polkit->priv->cache_misses = 0;
+	polkit->priv->connection = NULL;
+	polkit->priv->name_owner_changed_id = 0;
 
 #ifdef USE_SECURITY_POLKIT_NEW
-	polkit->priv->authority = polkit_authority_get_sync (NULL, &error);
-	if (polkit->priv->authority == NULL) {
-		g_error ("failed to get pokit authority: %s", error->message);
-		g_error_free (error);
-		goto out;
-	}
+	/* Checks made before the authority is ready wait for it */
+	polkit->priv->authority = NULL;
+	polkit->priv->authority_pending = TRUE;
+	polkit_authority_get_async (NULL, urf_polkit_authority_ready_cb,
+				    g_object_ref (polkit));
 #else
 	polkit->priv->authority = polkit_authority_get ();
+	polkit->priv->authority_pending = FALSE;
+	g_signal_connect (polkit->priv->authority, "changed",
+			  G_CALLBACK (urf_polkit_authority_changed_cb), polkit);
 #endif
-out:
-	return;
 }
 
 /**
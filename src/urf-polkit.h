@@ -52,12 +52,17 @@ GType		 urf_polkit_get_type		(void);
 UrfPolkit	*urf_polkit_new			(void);
 void		 urf_polkit_test		(gpointer		 user_data);
 
-PolkitSubject	*urf_polkit_get_subject		(UrfPolkit		*polkit,
-						 GDBusMethodInvocation	*invocation);
-gboolean	 urf_polkit_check_auth		(UrfPolkit		*polkit,
-						 PolkitSubject		*subject,
+void		 urf_polkit_check_auth_async	(UrfPolkit		*polkit,
+						 GDBusMethodInvocation	*invocation,
 						 const gchar		*action_id,
-						 GDBusMethodInvocation	*invocation);
+						 GCancellable		*cancellable,
+						 GAsyncReadyCallback	 callback,
+						 gpointer		 user_data);
+gboolean	 urf_polkit_check_auth_finish	(UrfPolkit		*polkit,
+						 GAsyncResult		*res,
+						 GError			**error);
+guint		 urf_polkit_get_cache_hits	(UrfPolkit		*polkit);
+guint		 urf_polkit_get_cache_misses	(UrfPolkit		*polkit);
 G_END_DECLS
 
 #endif /* __URF_POLKIT_H */
@@ -0,0 +1,117 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Objects whose D-Bus visible state changed queue themselves here
+ * instead of emitting their signals right away. All queued objects are
+ * flushed from a single idle callback, in the order they were first
+ * queued, and each flush function emits the signals for the state the
+ * object has at that point. A burst of rfkill events therefore results
+ * in at most one set of signals per object.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "urf-signal-scheduler.h"
+
+static GHashTable *pending = NULL; /* GObject -> UrfSignalFlushFunc */
+static GQueue order = G_QUEUE_INIT;
+static guint idle_id = 0;
+
+/**
+ * object_disposed_cb:
+ **/
+static void
+object_disposed_cb (gpointer  data,
+		    GObject  *where_the_object_was)
+{
+	g_hash_table_remove (pending, where_the_object_was);
+	g_queue_remove (&order, where_the_object_was);
+}
+
+/**
+ * flush_idle_cb:
+ **/
+static gboolean
+flush_idle_cb (gpointer user_data)
+{
+	idle_id = 0;
+	urf_signal_scheduler_flush ();
+
+	return FALSE;
+}
+
+/**
+ * urf_signal_scheduler_flush:
+ *
+ * Emits the signals of every queued object now.
+ **/
+void
+urf_signal_scheduler_flush (void)
+{
+	UrfSignalFlushFunc func;
+	GObject *object;
+
+	if (idle_id > 0) {
+		g_source_remove (idle_id);
+		idle_id = 0;
+	}
+
+	while ((object = g_queue_pop_head (&order)) != NULL) {
+		func = (UrfSignalFlushFunc) g_hash_table_lookup (pending, object);
+		g_hash_table_remove (pending, object);
+		g_object_weak_unref (object, object_disposed_cb, NULL);
+
+		func (object);
+	}
+}
+
+/**
+ * urf_signal_scheduler_queue:
+ *
+ * Schedules @func to be called for @object from the next idle cycle.
+ * Queueing an object that is already pending does nothing, and an
+ * object that goes away before then is simply dropped.
+ **/
+void
+urf_signal_scheduler_queue (GObject            *object,
+			    UrfSignalFlushFunc  func)
+{
+	g_return_if_fail (G_IS_OBJECT (object));
+	g_return_if_fail (func != NULL);
+
+	if (pending == NULL)
+		pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	if (g_hash_table_contains (pending, object))
+		return;
+
+	g_hash_table_insert (pending, object, (gpointer) func);
+	g_queue_push_tail (&order, object);
+	g_object_weak_ref (object, object_disposed_cb, NULL);
+
+	if (idle_id == 0)
+		idle_id = g_idle_add (flush_idle_cb, NULL);
+}
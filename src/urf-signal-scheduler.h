@@ -0,0 +1,36 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __URF_SIGNAL_SCHEDULER_H__
+#define __URF_SIGNAL_SCHEDULER_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef void (*UrfSignalFlushFunc) (GObject *object);
+
+void			 urf_signal_scheduler_queue		(GObject		*object,
+								 UrfSignalFlushFunc	 func);
+void			 urf_signal_scheduler_flush		(void);
+
+G_END_DECLS
+
+#endif /* __URF_SIGNAL_SCHEDULER_H__ */
@@ -0,0 +1,464 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Compact binary store for the persisted killswitch states.
+ *
+ * The base file holds one bit per type for "soft" and "prev-soft", plus
+ * a bit telling whether the value was ever set, behind a small header
+ * with a magic, a version and a checksum. Every change is appended to a
+ * journal file as a 4 byte record with its own check byte, so a write
+ * costs a few bytes and a record torn by a crash is simply ignored on
+ * the next load. Once the journal grows past JOURNAL_MAX_RECORDS the
+ * states are written to a new base file and the journal is truncated.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <linux/rfkill.h>
+
+#include "urf-state-store.h"
+#include "urf-utils.h"
+
+#define STORE_MAGIC		0x53465255 /* "URFS" */
+#define STORE_VERSION		1
+#define JOURNAL_SUFFIX		".journal"
+#define JOURNAL_MAX_RECORDS	64
+
+G_STATIC_ASSERT (NUM_RFKILL_TYPES <= 32);
+
+typedef struct {
+	guint32 magic;
+	guint8  version;
+	guint8  num_types;
+	guint16 reserved;
+	guint32 known[URF_STATE_FIELD_LAST];
+	guint32 value[URF_STATE_FIELD_LAST];
+	guint32 checksum;
+} StoreHeader;
+
+typedef struct {
+	guint8 type;
+	guint8 field;
+	guint8 value;
+	guint8 check;
+} JournalRecord;
+
+struct UrfStateStore {
+	char	*filename;
+	char	*journal_name;
+	int	 journal_fd;
+	guint	 journal_records;
+	guint32	 known[URF_STATE_FIELD_LAST];
+	guint32	 value[URF_STATE_FIELD_LAST];
+};
+
+/**
+ * header_checksum:
+ *
+ * FNV-1a over every byte of the header but the checksum itself.
+ **/
+static guint32
+header_checksum (const StoreHeader *header)
+{
+	const guint8 *p = (const guint8 *) header;
+	guint32 hash = 2166136261u;
+	gsize i;
+
+	for (i = 0; i < G_STRUCT_OFFSET (StoreHeader, checksum); i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * record_check:
+ **/
+static guint8
+record_check (const JournalRecord *record)
+{
+	return 0xa5 ^ record->type ^ (record->field << 4) ^ record->value;
+}
+
+/**
+ * apply:
+ **/
+static void
+apply (UrfStateStore *store,
+       gint           type,
+       UrfStateField  field,
+       gboolean       value)
+{
+	guint32 bit = 1u << type;
+
+	store->known[field] |= bit;
+	if (value)
+		store->value[field] |= bit;
+	else
+		store->value[field] &= ~bit;
+}
+
+/**
+ * load_base:
+ **/
+static void
+load_base (UrfStateStore *store)
+{
+	StoreHeader header;
+	char *contents = NULL;
+	gsize length;
+	GError *error = NULL;
+
+	if (!g_file_get_contents (store->filename, &contents, &length, &error)) {
+		g_debug ("No state store loaded: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	if (length != sizeof(header)) {
+		g_warning ("State store %s has an invalid size", store->filename);
+		g_free (contents);
+		return;
+	}
+
+	memcpy (&header, contents, sizeof(header));
+	g_free (contents);
+
+	if (header.magic != STORE_MAGIC ||
+	    header.version != STORE_VERSION ||
+	    header.checksum != header_checksum (&header)) {
+		g_warning ("State store %s is corrupted, ignoring it", store->filename);
+		return;
+	}
+
+	memcpy (store->known, header.known, sizeof(store->known));
+	memcpy (store->value, header.value, sizeof(store->value));
+}
+
+/**
+ * replay_journal:
+ **/
+static void
+replay_journal (UrfStateStore *store)
+{
+	JournalRecord *records;
+	char *contents = NULL;
+	gsize length;
+	guint i, count;
+
+	if (!g_file_get_contents (store->journal_name, &contents, &length, NULL))
+		return;
+
+	/* a partial record at the end was torn by a crash */
+	records = (JournalRecord *) contents;
+	count = length / sizeof(JournalRecord);
+
+	for (i = 0; i < count; i++) {
+		JournalRecord *record = &records[i];
+
+		if (record->check != record_check (record) ||
+		    record->type >= NUM_RFKILL_TYPES ||
+		    record->field >= URF_STATE_FIELD_LAST) {
+			g_warning ("State journal %s is corrupted at record %u",
+				   store->journal_name, i);
+			break;
+		}
+
+		apply (store, record->type, record->field, record->value);
+	}
+
+	store->journal_records = count;
+	g_free (contents);
+}
+
+/**
+ * write_base:
+ **/
+static gboolean
+write_base (UrfStateStore *store)
+{
+	StoreHeader header;
+	GError *error = NULL;
+
+	memset (&header, 0, sizeof(header));
+	header.magic = STORE_MAGIC;
+	header.version = STORE_VERSION;
+	header.num_types = NUM_RFKILL_TYPES;
+	memcpy (header.known, store->known, sizeof(header.known));
+	memcpy (header.value, store->value, sizeof(header.value));
+	header.checksum = header_checksum (&header);
+
+	if (!g_file_set_contents (store->filename, (const char *) &header,
+				  sizeof(header), &error)) {
+		g_warning ("Failed to write state store: %s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	g_chmod (store->filename, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+	return TRUE;
+}
+
+/**
+ * fold_journal:
+ *
+ * Writes the current states as the new base file and drops the journal.
+ **/
+static void
+fold_journal (UrfStateStore *store)
+{
+	/* the journal is only dropped once the base file is safe */
+	if (!write_base (store))
+		return;
+
+	if (store->journal_fd >= 0 && ftruncate (store->journal_fd, 0) < 0)
+		g_warning ("Failed to truncate state journal: %s", g_strerror (errno));
+
+	store->journal_records = 0;
+}
+
+/**
+ * urf_state_store_sync:
+ *
+ * Folds the journal into a new base file.
+ **/
+void
+urf_state_store_sync (UrfStateStore *store)
+{
+	g_return_if_fail (store != NULL);
+
+	if (store->journal_records == 0 && g_file_test (store->filename, G_FILE_TEST_EXISTS))
+		return;
+
+	fold_journal (store);
+}
+
+/**
+ * urf_state_store_get:
+ *
+ * Return value: #TRUE if a value was ever stored for @type and @field
+ **/
+gboolean
+urf_state_store_get (UrfStateStore *store,
+		     gint           type,
+		     UrfStateField  field,
+		     gboolean      *value)
+{
+	guint32 bit;
+
+	g_return_val_if_fail (store != NULL, FALSE);
+	g_return_val_if_fail (type >= 0 && type < NUM_RFKILL_TYPES, FALSE);
+	g_return_val_if_fail (field < URF_STATE_FIELD_LAST, FALSE);
+
+	bit = 1u << type;
+	*value = (store->value[field] & bit) != 0;
+
+	return (store->known[field] & bit) != 0;
+}
+
+/**
+ * urf_state_store_set:
+ **/
+void
+urf_state_store_set (UrfStateStore *store,
+		     gint           type,
+		     UrfStateField  field,
+		     gboolean       value)
+{
+	JournalRecord record;
+	gboolean current;
+
+	g_return_if_fail (store != NULL);
+	g_return_if_fail (type >= 0 && type < NUM_RFKILL_TYPES);
+	g_return_if_fail (field < URF_STATE_FIELD_LAST);
+
+	value = !!value;
+	if (urf_state_store_get (store, type, field, &current) && current == value)
+		return;
+
+	apply (store, type, field, value);
+
+	record.type = type;
+	record.field = field;
+	record.value = value;
+	record.check = record_check (&record);
+
+	if (store->journal_fd < 0 ||
+	    write (store->journal_fd, &record, sizeof(record)) != sizeof(record)) {
+		g_warning ("Failed to append to state journal, rewriting the store");
+		urf_state_store_sync (store);
+		return;
+	}
+
+	if (++store->journal_records >= JOURNAL_MAX_RECORDS)
+		urf_state_store_sync (store);
+}
+
+/**
+ * urf_state_store_import_keyfile:
+ *
+ * Takes every state found in @key_file, in the saved-states format.
+ **/
+void
+urf_state_store_import_keyfile (UrfStateStore *store,
+				GKeyFile      *key_file)
+{
+	static const char *keys[URF_STATE_FIELD_LAST] = { "soft", "prev-soft" };
+	GError *error = NULL;
+	gboolean value;
+	gint type;
+	guint field;
+
+	g_return_if_fail (store != NULL);
+
+	for (type = RFKILL_TYPE_ALL; type < NUM_RFKILL_TYPES; type++) {
+		for (field = 0; field < URF_STATE_FIELD_LAST; field++) {
+			value = g_key_file_get_boolean (key_file,
+							type_to_string (type),
+							keys[field],
+							&error);
+			if (error) {
+				g_clear_error (&error);
+				continue;
+			}
+
+			apply (store, type, field, value);
+		}
+	}
+
+	/* Nothing was journalled, so a sync would keep the empty base */
+	fold_journal (store);
+}
+
+/**
+ * urf_state_store_export_keyfile:
+ *
+ * Writes every known state to @key_file, in the saved-states format.
+ **/
+void
+urf_state_store_export_keyfile (UrfStateStore *store,
+				GKeyFile      *key_file)
+{
+	static const char *keys[URF_STATE_FIELD_LAST] = { "soft", "prev-soft" };
+	gboolean value;
+	gint type;
+	guint field;
+
+	g_return_if_fail (store != NULL);
+
+	for (type = RFKILL_TYPE_ALL; type < NUM_RFKILL_TYPES; type++) {
+		for (field = 0; field < URF_STATE_FIELD_LAST; field++) {
+			if (urf_state_store_get (store, type, field, &value))
+				g_key_file_set_boolean (key_file,
+							type_to_string (type),
+							keys[field],
+							value);
+		}
+	}
+}
+
+/**
+ * urf_state_store_exists:
+ **/
+gboolean
+urf_state_store_exists (const char *filename)
+{
+	return g_file_test (filename, G_FILE_TEST_EXISTS);
+}
+
+/**
+ * urf_state_store_remove:
+ *
+ * Deletes the store and its journal, e.g. once migrated to a key file.
+ **/
+void
+urf_state_store_remove (const char *filename)
+{
+	char *journal_name = g_strconcat (filename, JOURNAL_SUFFIX, NULL);
+
+	g_unlink (journal_name);
+	g_unlink (filename);
+	g_free (journal_name);
+}
+
+/**
+ * urf_state_store_open:
+ *
+ * Loads the store at @filename, replays its journal and keeps the
+ * journal open for appending.
+ **/
+UrfStateStore *
+urf_state_store_open (const char *filename)
+{
+	UrfStateStore *store;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	store = g_new0 (UrfStateStore, 1);
+	store->filename = g_strdup (filename);
+	store->journal_name = g_strconcat (filename, JOURNAL_SUFFIX, NULL);
+
+	load_base (store);
+	replay_journal (store);
+
+	store->journal_fd = open (store->journal_name,
+				  O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+				  S_IRUSR | S_IWUSR);
+	if (store->journal_fd < 0)
+		g_warning ("Failed to open state journal %s: %s",
+			   store->journal_name, g_strerror (errno));
+
+	/* fold what was replayed, so the journal only holds new changes */
+	urf_state_store_sync (store);
+
+	return store;
+}
+
+/**
+ * urf_state_store_free:
+ **/
+void
+urf_state_store_free (UrfStateStore *store)
+{
+	if (store == NULL)
+		return;
+
+	urf_state_store_sync (store);
+
+	if (store->journal_fd >= 0)
+		close (store->journal_fd);
+
+	g_free (store->journal_name);
+	g_free (store->filename);
+	g_free (store);
+}
@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __URF_STATE_STORE_H__
+#define __URF_STATE_STORE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	URF_STATE_FIELD_SOFT = 0,
+	URF_STATE_FIELD_PREV_SOFT,
+	URF_STATE_FIELD_LAST
+} UrfStateField;
+
+typedef struct UrfStateStore UrfStateStore;
+
+UrfStateStore		*urf_state_store_open			(const char	*filename);
+void			 urf_state_store_free			(UrfStateStore	*store);
+gboolean		 urf_state_store_exists			(const char	*filename);
+void			 urf_state_store_remove			(const char	*filename);
+gboolean		 urf_state_store_get			(UrfStateStore	*store,
+								 gint		 type,
+								 UrfStateField	 field,
+								 gboolean	*value);
+void			 urf_state_store_set			(UrfStateStore	*store,
+								 gint		 type,
+								 UrfStateField	 field,
+								 gboolean	 value);
+void			 urf_state_store_sync			(UrfStateStore	*store);
+void			 urf_state_store_import_keyfile		(UrfStateStore	*store,
+								 GKeyFile	*key_file);
+void			 urf_state_store_export_keyfile		(UrfStateStore	*store,
+								 GKeyFile	*key_file);
+
+G_END_DECLS
+
+#endif /* __URF_STATE_STORE_H__ */
@@ -2,6 +2,47 @@
 #include <libudev.h>
 #include "urf-utils.h"
 
+#define DMI_SYSFS_DIR "/sys/class/dmi/id"
+
+static char *
+read_dmi_attr (const char *attr)
+{
+	char *path;
+	char *value = NULL;
+
+	path = g_build_filename (DMI_SYSFS_DIR, attr, NULL);
+	if (g_file_get_contents (path, &value, NULL, NULL))
+		g_strchomp (value);
+	g_free (path);
+
+	return value;
+}
+
+/**
+ * get_dmi_info_from_sysfs:
+ *
+ * Read the DMI attributes straight from sysfs, which is what the udev
+ * enumeration below ends up doing anyway, minus the device scan.
+ **/
+static DmiInfo *
+get_dmi_info_from_sysfs (void)
+{
+	DmiInfo *info;
+
+	if (!g_file_test (DMI_SYSFS_DIR, G_FILE_TEST_IS_DIR))
+		return NULL;
+
+	info = g_new0 (DmiInfo, 1);
+	info->sys_vendor = read_dmi_attr ("sys_vendor");
+	info->bios_date = read_dmi_attr ("bios_date");
+	info->bios_vendor = read_dmi_attr ("bios_vendor");
+	info->bios_version = read_dmi_attr ("bios_version");
+	info->product_name = read_dmi_attr ("product_name");
+	info->product_version = read_dmi_attr ("product_version");
+
+	return info;
+}
+
 /**
  * get_dmi_info:
  **/
@@ -15,6 +56,10 @@ get_dmi_info ()
 	struct udev_device *dev;
 	DmiInfo *info = NULL;
 
+	info = get_dmi_info_from_sysfs ();
+	if (info)
+		return info;
+
 	udev = udev_new ();
 	if (!udev) {
 		g_warning ("Cannot create udev");
@@ -28,6 +73,8 @@ get_dmi_info ()
 
 	if (devices == NULL) {
 		g_warning("No dmi devices found.");
+		udev_enumerate_unref (enumerate);
+		udev_unref (udev);
 		return NULL;
 	}
 
@@ -87,6 +134,26 @@ dmi_info_free (DmiInfo *info)
 	g_free (info);
 }
 
+/**
+ * get_udev_context:
+ *
+ * Return the udev context shared by the daemon. It lives as long as the
+ * process, the caller must not unref it.
+ **/
+struct udev *
+get_udev_context (void)
+{
+	static struct udev *udev = NULL;
+
+	if (udev == NULL) {
+		udev = udev_new ();
+		if (udev == NULL)
+			g_warning ("Cannot create udev");
+	}
+
+	return udev;
+}
+
 /**
  * get_rfkill_device_by_index:
  **/
@@ -98,9 +165,17 @@ get_rfkill_device_by_index (struct udev *udev,
 	struct udev_list_entry *devices;
 	struct udev_list_entry *dev_list_entry;
 	struct udev_device *dev;
+	char *syspath;
 
 	g_return_val_if_fail (index >= 0, NULL);
 
+	/* The kernel names rfkill devices after their index */
+	syspath = g_strdup_printf ("/sys/class/rfkill/rfkill%d", index);
+	dev = udev_device_new_from_syspath (udev, syspath);
+	g_free (syspath);
+	if (dev)
+		return dev;
+
 	enumerate = udev_enumerate_new(udev);
 	udev_enumerate_add_match_subsystem(enumerate, "rfkill");
 	udev_enumerate_scan_devices(enumerate);
@@ -119,9 +194,118 @@ get_rfkill_device_by_index (struct udev *udev,
 		dev = NULL;
 	}
 
+	udev_enumerate_unref (enumerate);
+
 	return dev;
 }
 
+/**
+ * get_rfkill_device_info:
+ *
+ * Enumerate the rfkill subsystem once and collect what the daemon needs
+ * to know about every device.
+ *
+ * Return value: a hash table mapping the rfkill index to a
+ *               #RfkillDeviceInfo, or %NULL
+ **/
+GHashTable *
+get_rfkill_device_info (struct udev *udev)
+{
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *devices;
+	struct udev_list_entry *dev_list_entry;
+	struct udev_device *dev;
+	RfkillDeviceInfo *info;
+	GHashTable *table;
+
+	g_return_val_if_fail (udev != NULL, NULL);
+
+	table = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+				       (GDestroyNotify) rfkill_device_info_free);
+
+	enumerate = udev_enumerate_new(udev);
+	udev_enumerate_add_match_subsystem(enumerate, "rfkill");
+	udev_enumerate_scan_devices(enumerate);
+	devices = udev_enumerate_get_list_entry(enumerate);
+
+	udev_list_entry_foreach(dev_list_entry, devices) {
+		const char *path, *index_c;
+		path = udev_list_entry_get_name(dev_list_entry);
+		dev = udev_device_new_from_syspath(udev, path);
+		if (dev == NULL)
+			continue;
+
+		index_c = udev_device_get_sysattr_value (dev, "index");
+		if (index_c) {
+			info = g_new0 (RfkillDeviceInfo, 1);
+			info->name = g_strdup (udev_device_get_sysattr_value (dev, "name"));
+			info->platform = udev_device_get_parent_with_subsystem_devtype (dev, "platform", NULL) != NULL;
+			g_hash_table_insert (table, GINT_TO_POINTER (atoi (index_c)), info);
+		}
+
+		udev_device_unref (dev);
+	}
+
+	udev_enumerate_unref (enumerate);
+
+	return table;
+}
+
+/**
+ * rfkill_device_info_free:
+ **/
+void
+rfkill_device_info_free (RfkillDeviceInfo *info)
+{
+	g_free (info->name);
+	g_free (info);
+}
+
+/**
+ * get_interface_properties:
+ *
+ * Collect every readable property of an exported interface through its
+ * get_property handler, as needed for GetManagedObjects and
+ * InterfacesAdded.
+ *
+ * Return value: a floating a{sv} #GVariant
+ **/
+GVariant *
+get_interface_properties (GDBusConnection            *connection,
+			  const char                 *object_path,
+			  GDBusInterfaceInfo         *info,
+			  const GDBusInterfaceVTable *vtable,
+			  gpointer                    user_data)
+{
+	GVariantBuilder builder;
+	GDBusPropertyInfo *prop;
+	GVariant *value;
+	GError *error = NULL;
+	guint i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+	for (i = 0; info->properties && info->properties[i]; i++) {
+		prop = info->properties[i];
+		if (!(prop->flags & G_DBUS_PROPERTY_INFO_FLAGS_READABLE) ||
+		    vtable->get_property == NULL)
+			continue;
+
+		value = vtable->get_property (connection, NULL, object_path,
+					      info->name, prop->name,
+					      &error, user_data);
+		if (value == NULL) {
+			if (error)
+				g_clear_error (&error);
+			continue;
+		}
+
+		g_variant_builder_add (&builder, "{sv}", prop->name, value);
+	}
+
+	return g_variant_builder_end (&builder);
+}
+
 KillswitchState
 event_to_state (gboolean soft,
 		gboolean hard)
@@ -22,6 +22,7 @@
 #define __URF_UTILS_H__
 
 #include <glib.h>
+#include <gio/gio.h>
 #include <libudev.h>
 #include <linux/rfkill.h>
 
@@ -41,10 +42,23 @@ typedef struct {
 	char *product_version;
 } DmiInfo;
 
+typedef struct {
+	char	 *name;
+	gboolean  platform;
+} RfkillDeviceInfo;
+
 DmiInfo			*get_dmi_info			(void);
 void			 dmi_info_free			(DmiInfo	*info);
+struct udev		*get_udev_context		(void);
 struct udev_device 	*get_rfkill_device_by_index	(struct udev	*udev,
 							 gint		 index);
+GHashTable		*get_rfkill_device_info		(struct udev	*udev);
+void			 rfkill_device_info_free	(RfkillDeviceInfo *info);
+GVariant		*get_interface_properties	(GDBusConnection *connection,
+							 const char	*object_path,
+							 GDBusInterfaceInfo *info,
+							 const GDBusInterfaceVTable *vtable,
+							 gpointer	 user_data);
 KillswitchState		 event_to_state			(gboolean	 soft,
 							 gboolean	 hard);
 const char 		*state_to_string		(KillswitchState state);